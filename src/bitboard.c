@@ -2,88 +2,17 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include "bitboard.h"
-#include "table.h"
+
+#ifdef PEXT_BACKEND
+#include <cpuid.h>
+#endif
 
 const Bitboard NOT_A_FILE = 18374403900871474942ULL;
 const Bitboard NOT_H_FILE = 9187201950435737471ULL;
 const Bitboard NOT_HG_FILE = 4557430888798830399ULL;
 const Bitboard NOT_AB_FILE = 18229723555195321596ULL;
 
-const Bitboard rook_magics[64] = {
-    0x8a80104000800020ULL, 0x140002000100040ULL, 0x2801880a0017001ULL,
-    0x100081001000420ULL, 0x200020010080420ULL, 0x3001c0002010008ULL,
-    0x8480008002000100ULL, 0x2080088004402900ULL, 0x800098204000ULL,
-    0x2024401000200040ULL, 0x100802000801000ULL, 0x120800800801000ULL,
-    0x208808088000400ULL, 0x2802200800400ULL, 0x2200800100020080ULL, 
-    0x801000060821100ULL,0x80044006422000ULL, 0x100808020004000ULL,
-    0x12108a0010204200ULL, 0x140848010000802ULL, 0x481828014002800ULL,
-    0x8094004002004100ULL, 0x4010040010010802ULL, 0x20008806104ULL,
-    0x100400080208000ULL, 0x2040002120081000ULL, 0x21200680100081ULL, 
-    0x20100080080080ULL, 0x2000a00200410ULL, 0x20080800400ULL,
-    0x80088400100102ULL, 0x80004600042881ULL, 0x4040008040800020ULL,
-    0x440003000200801ULL, 0x4200011004500ULL, 0x188020010100100ULL,
-    0x14800401802800ULL, 0x2080040080800200ULL, 0x124080204001001ULL,
-    0x200046502000484ULL, 0x480400080088020ULL, 0x1000422010034000ULL,
-    0x30200100110040ULL, 0x100021010009ULL, 0x2002080100110004ULL,
-    0x202008004008002ULL, 0x20020004010100ULL, 0x2048440040820001ULL,
-    0x101002200408200ULL, 0x40802000401080ULL, 0x4008142004410100ULL,
-    0x2060820c0120200ULL, 0x1001004080100ULL, 0x20c020080040080ULL,
-    0x2935610830022400ULL, 0x44440041009200ULL, 0x280001040802101ULL,
-    0x2100190040002085ULL, 0x80c0084100102001ULL, 0x4024081001000421ULL,
-    0x20030a0244872ULL, 0x12001008414402ULL, 0x2006104900a0804ULL,
-    0x1004081002402ULL,
-};
-
-const Bitboard bishop_magics[64] = {
-    0x40040844404084ULL, 0x2004208a004208ULL, 0x10190041080202ULL,
-    0x108060845042010ULL, 0x581104180800210ULL, 0x2112080446200010ULL,
-    0x1080820820060210ULL, 0x3c0808410220200ULL, 0x4050404440404ULL,
-    0x21001420088ULL, 0x24d0080801082102ULL, 0x1020a0a020400ULL,
-    0x40308200402ULL, 0x4011002100800ULL, 0x401484104104005ULL,
-    0x801010402020200ULL, 0x400210c3880100ULL, 0x404022024108200ULL,
-    0x810018200204102ULL, 0x4002801a02003ULL, 0x85040820080400ULL,
-    0x810102c808880400ULL, 0xe900410884800ULL, 0x8002020480840102ULL,
-    0x220200865090201ULL, 0x2010100a02021202ULL, 0x152048408022401ULL,
-    0x20080002081110ULL, 0x4001001021004000ULL, 0x800040400a011002ULL,
-    0xe4004081011002ULL, 0x1c004001012080ULL, 0x8004200962a00220ULL,
-    0x8422100208500202ULL, 0x2000402200300c08ULL, 0x8646020080080080ULL,
-    0x80020a0200100808ULL, 0x2010004880111000ULL, 0x623000a080011400ULL,
-    0x42008c0340209202ULL, 0x209188240001000ULL, 0x400408a884001800ULL,
-    0x110400a6080400ULL, 0x1840060a44020800ULL, 0x90080104000041ULL,
-    0x201011000808101ULL, 0x1a2208080504f080ULL, 0x8012020600211212ULL,
-    0x500861011240000ULL, 0x180806108200800ULL, 0x4000020e01040044ULL,
-    0x300000261044000aULL, 0x802241102020002ULL, 0x20906061210001ULL,
-    0x5a84841004010310ULL, 0x4010801011c04ULL, 0xa010109502200ULL,
-    0x4a02012000ULL, 0x500201010098b028ULL, 0x8040002811040900ULL,
-    0x28000010020204ULL, 0x6000020202d0240ULL, 0x8918844842082200ULL,
-    0x4010011029020020ULL
-};
-
-// The number of relevant occupancy squares within the path of the bishop's attack mask.
-// See [gen.c] for how this was calculated.
-const int bishop_relevant_bits[64] = {
-    6, 5, 5, 5, 5, 5, 5, 6,
-    5, 5, 5, 5, 5, 5, 5, 5,
-    5, 5, 7, 7, 7, 7, 5, 5,
-    5, 5, 7, 9, 9, 7, 5, 5,
-    5, 5, 7, 9, 9, 7, 5, 5,
-    5, 5, 7, 7, 7, 7, 5, 5,
-    5, 5, 5, 5, 5, 5, 5, 5,
-    6, 5, 5, 5, 5, 5, 5, 6,
-};
-
-// The number of relevant occupancy squares within the path of the rook's attack mask.
-// See [gen.c] for how this was calculated.
-const int rook_relevant_bits[64] = {
-    12, 11, 11, 11, 11, 11, 11, 12,
-    11, 10, 10, 10, 10, 10, 10, 11,
-    11, 10, 10, 10, 10, 10, 10, 11,
-    11, 10, 10, 10, 10, 10, 10, 11,
-    11, 10, 10, 10, 10, 10, 10, 11,
-    11, 10, 10, 10, 10, 10, 10, 11,
-    11, 10, 10, 10, 10, 10, 10, 11,
-    12, 11, 11, 11, 11, 11, 11, 12,
-};
+// rook_magics, bishop_magics and their relevant bits are in [magic_numbers.c], written by make magics
 
 char ascii_pieces[12] = "PNBRQKpnbrqk";
 
@@ -103,12 +32,49 @@ int char_pieces[] = {
     ['k'] = k
 };
 
+/*
+ Attack tables are shared by every board and thread.
+ They are filled once by init_tables() at startup and only read afterwards,
+ or compiled in as const data when built with USE_GENERATED_TABLES.
+*/
+#ifdef USE_GENERATED_TABLES
+#include "generated_attacks.h"
+#else
 // Bishop attack masks
 Bitboard bishop_masks[64];
 
 // Rook attack masks
 Bitboard rook_masks[64];
 
+Bitboard pawn_attacks[2][64];
+Bitboard knight_attacks[64];
+Bitboard king_attacks[64];
+
+/*
+ Slider attacks, indexed by [offset of square + magic index] or [offset of square + PEXT index].
+ Each square only gets the entries it can index, instead of a fixed 512 or 4096 entry stripe,
+ so the rook table is at most 800KB rather than 2MB and the bishop table at most 41KB rather than 256KB.
+ A magic index has the square's relevant bits, which can be fewer than the bits in its mask, while a PEXT index
+ always has the mask bits. Each backend has its own offsets.
+*/
+Bitboard bishop_attacks[BISHOP_MAGIC_TABLE_SIZE];
+Bitboard rook_attacks[ROOK_MAGIC_TABLE_SIZE];
+Bitboard bishop_pext_attacks[BISHOP_PEXT_TABLE_SIZE];
+Bitboard rook_pext_attacks[ROOK_PEXT_TABLE_SIZE];
+int bishop_offsets[64];
+int rook_offsets[64];
+int bishop_pext_offsets[64];
+int rook_pext_offsets[64];
+
+/*
+ between_squares holds the squares strictly between two squares on the same rank, file or diagonal.
+ line_squares holds the full line through both squares, edge to edge.
+ Both are empty when the squares are not aligned.
+*/
+Bitboard between_squares[64][64];
+Bitboard line_squares[64][64];
+#endif
+
 // Pawn attacks
 Bitboard mask_pawn_attacks(int side, int square) {
     // Attack bitboard
@@ -365,7 +331,9 @@ Bitboard generate_rook_attacks(int square, Bitboard block) {
     return attacks;
 }
 
-void init_siders(int is_bishop, Board *board) {
+#ifndef USE_GENERATED_TABLES
+void init_siders(int is_bishop) {
+    int offset = 0, pext_offset = 0;
     for (int s = 0; s < 64; s++) {
         bishop_masks[s] = mask_bishop_attacks(s);
         rook_masks[s] = mask_rook_attacks(s);
@@ -378,35 +346,85 @@ void init_siders(int is_bishop, Board *board) {
         // Slider occupancy
          int occupancy_indicies = (1 << relevant_bit_count);
 
+        if (is_bishop) {
+            bishop_offsets[s] = offset;
+            bishop_pext_offsets[s] = pext_offset;
+        } else {
+            rook_offsets[s] = offset;
+            rook_pext_offsets[s] = pext_offset;
+        }
+
+         // set_occupancy(i) deposits the bits of i into the mask in order, so i is also the PEXT index of the occupancy
          for (int i = 0; i < occupancy_indicies; i++) {
             Bitboard occupancy = set_occupancy(i, relevant_bit_count, attack_mask);
             if (is_bishop) {
                 int magic_index = (occupancy * bishop_magics[s]) >> (64 - bishop_relevant_bits[s]);
-                board->bishop_attacks[s * 512 + magic_index] = generate_bishop_attacks(s, occupancy);
+                bishop_attacks[offset + magic_index] = generate_bishop_attacks(s, occupancy);
+                bishop_pext_attacks[pext_offset + i] = bishop_attacks[offset + magic_index];
             } else {
                 int magic_index = (occupancy * rook_magics[s]) >> (64 - rook_relevant_bits[s]);
-                board->rook_attacks[s * 4096 + magic_index] = generate_rook_attacks(s, occupancy);
+                rook_attacks[offset + magic_index] = generate_rook_attacks(s, occupancy);
+                rook_pext_attacks[pext_offset + i] = rook_attacks[offset + magic_index];
             }
          }
+        // A magic index has the square's relevant bits, which can be fewer than the mask bits of a PEXT index
+        offset += 1 << (is_bishop ? bishop_relevant_bits[s] : rook_relevant_bits[s]);
+        pext_offset += occupancy_indicies;
+    }
+}
+#endif
+
+int slider_backend = SLIDERS_MAGIC;
+const char *slider_backend_names[] = { "magic", "pext" };
+
+int pext_supported() {
+#ifdef PEXT_BACKEND
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("bmi2");
+#else
+    return 0;
+#endif
+}
+
+// AMD CPUs before Zen 3 (family 19h) have BMI2, but run PEXT in microcode, far slower than the magic multiply.
+int pext_fast() {
+#ifdef PEXT_BACKEND
+    if (!pext_supported()) {
+        return 0;
+    }
+    if (__builtin_cpu_is("amd")) {
+        unsigned int eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            return 0;
+        }
+        int family = (eax >> 8) & 0xf;
+        if (family == 0xf) {
+            family += (eax >> 20) & 0xff;
+        }
+        return family >= 0x19;
     }
+    return 1;
+#else
+    return 0;
+#endif
 }
 
-Bitboard get_bishop_attacks(int square, Bitboard occupancy, Board *board) {
-    occupancy &= bishop_masks[square];
-    occupancy *= bishop_magics[square];
-    occupancy >>= 64 - bishop_relevant_bits[square];
-    return board->bishop_attacks[square * 512 + occupancy];
+// Returns 0 if the backend is not supported on this CPU, leaving the current backend selected.
+int set_slider_backend(int backend) {
+    if (backend != SLIDERS_MAGIC && (backend != SLIDERS_PEXT || !pext_supported())) {
+        return 0;
+    }
+    slider_backend = backend;
+    return 1;
 }
 
-Bitboard get_rook_attacks(int square, Bitboard occupancy, Board *board) {
-    occupancy &= rook_masks[square];
-    occupancy *= rook_magics[square];
-    occupancy >>= 64 - rook_relevant_bits[square];
-    return board->rook_attacks[square * 4096 + occupancy];
+// Uses PEXT when the CPU runs it fast, otherwise the magic lookups
+void init_slider_backend() {
+    set_slider_backend(pext_fast() ? SLIDERS_PEXT : SLIDERS_MAGIC);
 }
 
-Bitboard get_queen_attacks(int square, Bitboard occupancy, Board *board) {
-    return (get_bishop_attacks(square, occupancy, board) | get_rook_attacks(square, occupancy, board));
+Bitboard get_queen_attacks(int square, Bitboard occupancy) {
+    return (get_bishop_attacks(square, occupancy) | get_rook_attacks(square, occupancy));
 }
 
 
@@ -436,23 +454,46 @@ Bitboard set_occupancy(int index, int bits_mask, Bitboard attack_mask) {
     return occupancy;
 }
 
+#ifndef USE_GENERATED_TABLES
 // Generate attack tables
-void init_tables(Board *board) {
+void init_tables() {
     for (int square = 0; square < 64; square++) {
         // Pawn attacks
-        board->pawn_attacks[WHITE][square] = mask_pawn_attacks(WHITE, square);
-        board->pawn_attacks[BLACK][square] = mask_pawn_attacks(BLACK, square);
+        pawn_attacks[WHITE][square] = mask_pawn_attacks(WHITE, square);
+        pawn_attacks[BLACK][square] = mask_pawn_attacks(BLACK, square);
 
         // Kinght attacks
-        board->knight_attacks[square] = mask_knight_attacks(square);
+        knight_attacks[square] = mask_knight_attacks(square);
 
         // King attacks
-        board->king_attacks[square] = mask_king_attacks(square);
+        king_attacks[square] = mask_king_attacks(square);
     }
 
-    init_siders(sBISHOP, board);
-    init_siders(sROOK, board);
+    init_siders(sBISHOP);
+    init_siders(sROOK);
+}
+
+void init_line_tables() {
+    for (int s1 = 0; s1 < 64; s1++) {
+        Bitboard bishop_rays = generate_bishop_attacks(s1, 0ULL);
+        Bitboard rook_rays = generate_rook_attacks(s1, 0ULL);
+
+        for (int s2 = 0; s2 < 64; s2++) {
+            Bitboard squares = (1ULL << s1) | (1ULL << s2);
+            between_squares[s1][s2] = 0ULL;
+            line_squares[s1][s2] = 0ULL;
+
+            if (GET_BIT(bishop_rays, s2)) {
+                between_squares[s1][s2] = generate_bishop_attacks(s1, 1ULL << s2) & generate_bishop_attacks(s2, 1ULL << s1);
+                line_squares[s1][s2] = (bishop_rays & generate_bishop_attacks(s2, 0ULL)) | squares;
+            } else if (GET_BIT(rook_rays, s2)) {
+                between_squares[s1][s2] = generate_rook_attacks(s1, 1ULL << s2) & generate_rook_attacks(s2, 1ULL << s1);
+                line_squares[s1][s2] = (rook_rays & generate_rook_attacks(s2, 0ULL)) | squares;
+            }
+        }
+    }
 }
+#endif
 
 void print_bitboard(Bitboard bitboard) {
 
@@ -483,28 +524,20 @@ Board* create_board() {
         fprintf(stderr, "Memory allocation failed\n");
         exit(EXIT_FAILURE);
     }
-    board->bishop_attacks = malloc(64 * 512 * sizeof(Bitboard));
-    board->rook_attacks = malloc(64 * 4096 * sizeof(Bitboard));
     board->side = -1;
     board->enpassant = na;
     board->castle = 0;
     board->hash_key = 0ULL;
+    board->pawn_key = 0ULL;
+    board->material_key = 0ULL;
     board->repetition_index = 0;
     board->fifty_move_rule_counter = 0;
-
-    init_tables(board);
-    init_hash_table(128); // 128MB
-
-    if (board->bishop_attacks == NULL || board->rook_attacks == NULL) {
-        fprintf(stderr, "Memory allocation for attack tables failed\n");
-        exit(EXIT_FAILURE);
-    }
+    memset(board->mailbox, -1, sizeof(board->mailbox));
+    memset(&board->scores, 0, sizeof(board->scores));
 
     return board;
 }
 
 void free_board(Board *board) {
-    free(board->bishop_attacks);
-    free(board->rook_attacks);
     free(board);
 }
@@ -4,26 +4,75 @@
 #include <string.h>
 #include <stdint.h>
 
+#include "magic_numbers.h"
+
 typedef unsigned long long Bitboard;
 
-#define SET_BIT(bitboard, square) ((bitboard |= (1ULL << square)))
-#define GET_BIT(bitboard, square) ((bitboard & (1ULL <<  square)))
+#define SET_BIT(bitboard, square) ((bitboard) |= (1ULL << (square)))
+#define GET_BIT(bitboard, square) ((bitboard) & (1ULL << (square)))
 #define POP_BIT(bitboard, square) ((bitboard) &= ~(1ULL << (square)))
 #define count_bits(bitboard) __builtin_popcountll(bitboard)
 #define SQUARE_INDEX(rank, file) ((rank) * 8 + (file))
 
+/*
+ Lookup tables are built at startup by default.
+ Building with USE_GENERATED_TABLES (make generated) compiles them in as const data written by tools/generate_tables.c,
+ and startup does no table construction.
+*/
+#ifdef USE_GENERATED_TABLES
+#define TABLE_CONST const
+#else
+#define TABLE_CONST
+#endif
+
+// The PEXT backend needs BMI2, which is only checked for and compiled on x86-64 with GCC or Clang.
+// Building with -DNO_PEXT leaves it out, so the magic lookups are always used.
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(NO_PEXT)
+#define PEXT_BACKEND
+#endif
+
+// Total entries of each PEXT slider table: the sum over all squares of 2^(bits in the attack mask).
+// The magic tables are sized by the bits of each square's magic index instead, see magic_numbers.h.
+#define BISHOP_PEXT_TABLE_SIZE 5248
+#define ROOK_PEXT_TABLE_SIZE 102400
+
+#define MAX_GAME_PLY 1000
+
+// Accumulator size of the optional evaluation network, see nnue.h
+#define NNUE_HIDDEN 256
+
+// An opening and an endgame value packed into one int, see PACK_SCORE() in eval.h
+typedef int PackedScore;
+
+// Material, game phase and piece-square sums, indexed by side. Updated piece by piece as moves are made so evaluate() does not rebuild them.
+typedef struct {
+    int material[2];
+    PackedScore psq[2]; // Piece-square values with the material included
+    int phase;
+} PieceScores;
+
+// State make_move() cannot recover from the move itself. One record is pushed per move and restored by unmake_move().
+typedef struct {
+    Bitboard hash_key;
+    Bitboard pawn_key;
+    Bitboard material_key;
+    int enpassant;
+    int castle;
+    int fifty_move_rule_counter;
+    PieceScores scores;
+} BoardState;
+
 typedef struct {
     Bitboard bitboards[12];
     Bitboard occupancies[3];
-    Bitboard pawn_attacks[2][64];
-    Bitboard knight_attacks[64];
-    Bitboard king_attacks[64];
-    Bitboard *bishop_attacks;
-    Bitboard *rook_attacks;
-    Bitboard bishop_masks[64];
-    Bitboard rook_masks[64];
+    int8_t mailbox[64]; // Piece on each square, -1 when empty. Kept in sync with the bitboards.
+    PieceScores scores;
+    int16_t accumulator[2][NNUE_HIDDEN]; // First layer of the network from each side's perspective. Only kept up to date while a network is loaded.
     Bitboard hash_key;
-    Bitboard repetition_table[1000];
+    Bitboard pawn_key; // Zobrist key of the pawns only, for the pawn hash table
+    Bitboard material_key; // Zobrist key of the piece counts, for the material table
+    Bitboard repetition_table[MAX_GAME_PLY];
+    BoardState states[MAX_GAME_PLY]; // Indexed by repetition_index before the move was made
     int side;
     int enpassant;
     int castle;
@@ -31,23 +80,6 @@ typedef struct {
     int fifty_move_rule_counter; // Keep track of the 50 move rule for draw (100 plys)
 } Board;
 
-#define COPY_BOARD(board)                                                                       \
-    Bitboard bitboards_copy[12], occupancies_copy[3];                                           \
-    int side_copy, enpassant_copy, castle_copy, fifty_move_rule_counter_copy;                   \
-    memcpy(bitboards_copy, board->bitboards, sizeof(board->bitboards));                         \
-    memcpy(occupancies_copy, board->occupancies, sizeof(board->occupancies));                   \
-    side_copy = board->side, enpassant_copy = board->enpassant, castle_copy = board->castle;    \
-    fifty_move_rule_counter_copy = board->fifty_move_rule_counter;                              \
-    Bitboard hash_key_copy = board->hash_key;                                                   \
-
-#define UNDO(board)                                                                             \
-    memcpy(board->bitboards, bitboards_copy, 96);                                               \
-    memcpy(board->occupancies, occupancies_copy, 24);                                           \
-    board->side = side_copy, board->enpassant = enpassant_copy, board->castle = castle_copy;    \
-    board->repetition_index--;                                                                  \
-    board->fifty_move_rule_counter = fifty_move_rule_counter_copy;                              \
-    board->hash_key = hash_key_copy;                                                            \
-
 Bitboard mask_pawn_attacks(int, int);
 Bitboard mask_knight_attacks(int);
 Bitboard mask_king_attacks(int);
@@ -56,14 +88,25 @@ Bitboard mask_rook_attacks(int);
 Bitboard generate_bishop_attacks(int, Bitboard);
 Bitboard generate_rook_attacks(int, Bitboard);
 Bitboard set_occupancy(int, int, Bitboard);
-Bitboard get_bishop_attacks(int, Bitboard, Board*); 
-Bitboard get_rook_attacks(int, Bitboard, Board*); 
-Bitboard get_queen_attacks(int, Bitboard, Board*); 
+Bitboard get_queen_attacks(int, Bitboard);
+
+// Slider attack lookup backends. Both return the same attacks and only index their tables differently.
+enum { SLIDERS_MAGIC, SLIDERS_PEXT };
+
+extern int slider_backend;
+extern const char *slider_backend_names[];
+int pext_supported();
+int pext_fast();
+int set_slider_backend(int);
+void init_slider_backend();
 
 Board* create_board();
 void free_board(Board *board);
-void init_siders(int, Board*);
-void init_tables(Board*);
+#ifndef USE_GENERATED_TABLES
+void init_siders(int);
+void init_tables();
+void init_line_tables();
+#endif
 void print_bitboard(Bitboard);
 
 // get least significant 1st bit index
@@ -74,15 +117,6 @@ static inline int get_least_sig_bit_index(Bitboard bitboard) {
     return __builtin_ctzll(bitboard);
 }
 
-static inline int get_piece_at_square(int square, Bitboard bitboards[]) {
-    for (int piece = 0; piece < 12; piece++) {
-        if (GET_BIT(bitboards[piece], square)) {
-            return piece;
-        }
-    }
-    return -1;
-}
-
 // Array representing each index as the human-readable chess board coordinate
 // Required to follow UCI guidelines for moves
 static const char *square[] = {
@@ -123,7 +157,59 @@ extern const Bitboard bishop_magics[64];
 extern const Bitboard rook_magics[64];
 extern const int bishop_relevant_bits[64];
 extern const int rook_relevant_bits[64];
+extern TABLE_CONST Bitboard bishop_masks[64];
+extern TABLE_CONST Bitboard rook_masks[64];
+extern TABLE_CONST Bitboard pawn_attacks[2][64];
+extern TABLE_CONST Bitboard knight_attacks[64];
+extern TABLE_CONST Bitboard king_attacks[64];
+extern TABLE_CONST Bitboard bishop_attacks[BISHOP_MAGIC_TABLE_SIZE];
+extern TABLE_CONST Bitboard rook_attacks[ROOK_MAGIC_TABLE_SIZE];
+extern TABLE_CONST Bitboard bishop_pext_attacks[BISHOP_PEXT_TABLE_SIZE];
+extern TABLE_CONST Bitboard rook_pext_attacks[ROOK_PEXT_TABLE_SIZE];
+extern TABLE_CONST int bishop_offsets[64];
+extern TABLE_CONST int rook_offsets[64];
+extern TABLE_CONST int bishop_pext_offsets[64];
+extern TABLE_CONST int rook_pext_offsets[64];
+extern TABLE_CONST Bitboard between_squares[64][64];
+extern TABLE_CONST Bitboard line_squares[64][64];
 extern char ascii_pieces[12];
 extern int char_pieces[];
 
+
+#ifdef PEXT_BACKEND
+// Inline assembly instead of the BMI2 intrinsic, so the lookups can be inlined into code not compiled for BMI2.
+// It is only executed once set_slider_backend() has checked that the CPU has BMI2.
+static inline Bitboard pext(Bitboard value, Bitboard mask) {
+    Bitboard result;
+    __asm__("pextq %2, %1, %0" : "=r"(result) : "r"(value), "r"(mask));
+    return result;
+}
+#endif
+
+// Slider lookups are inlined and branch on the selected backend. The branch always goes the same way,
+// which costs less than calling the backend's lookup through a function pointer.
+static inline Bitboard get_bishop_attacks(int square, Bitboard occupancy) {
+#ifdef PEXT_BACKEND
+    if (slider_backend == SLIDERS_PEXT) {
+        return bishop_pext_attacks[bishop_pext_offsets[square] + pext(occupancy, bishop_masks[square])];
+    }
+#endif
+    occupancy &= bishop_masks[square];
+    occupancy *= bishop_magics[square];
+    occupancy >>= 64 - bishop_relevant_bits[square];
+    return bishop_attacks[bishop_offsets[square] + occupancy];
+}
+
+static inline Bitboard get_rook_attacks(int square, Bitboard occupancy) {
+#ifdef PEXT_BACKEND
+    if (slider_backend == SLIDERS_PEXT) {
+        return rook_pext_attacks[rook_pext_offsets[square] + pext(occupancy, rook_masks[square])];
+    }
+#endif
+    occupancy &= rook_masks[square];
+    occupancy *= rook_magics[square];
+    occupancy >>= 64 - rook_relevant_bits[square];
+    return rook_attacks[rook_offsets[square] + occupancy];
+}
+
 #endif
\ No newline at end of file
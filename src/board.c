@@ -3,17 +3,23 @@
 
 #include "bitboard.h"
 #include "table.h"
+#include "eval.h"
+#include "nnue.h"
 
 void reset_board(Board *board) {
     memset(board->bitboards, 0ULL, sizeof(board->bitboards));
     memset(board->occupancies, 0ULL, sizeof(board->occupancies));
+    memset(board->mailbox, -1, sizeof(board->mailbox));
     board->side = 0;
     board->enpassant = na;
     board->castle = 0;
     board->hash_key = 0ULL;
+    board->pawn_key = 0ULL;
+    board->material_key = 0ULL;
     board->repetition_index = 0;
     board->fifty_move_rule_counter = 0;
     memset(board->repetition_table, 0ULL, sizeof(board->repetition_table));
+    memset(&board->scores, 0, sizeof(board->scores));
 }
 
 /**
@@ -126,6 +132,15 @@ void load_fen(char* fen, Board *board) {
         If there becomes a need for this value, it can be implemented here.
     */
 
+    for (int piece = P; piece <= k; piece++) {
+        Bitboard bitboard = board->bitboards[piece];
+        while (bitboard) {
+            int square = get_least_sig_bit_index(bitboard);
+            board->mailbox[square] = piece;
+            POP_BIT(bitboard, square);
+        }
+    }
+
     for (int piece = P; piece <= K; piece++) {
         board->occupancies[WHITE] |= board->bitboards[piece];
     }
@@ -137,6 +152,12 @@ void load_fen(char* fen, Board *board) {
     board->occupancies[BOTH] |= board->occupancies[BLACK];
 
     board->hash_key = generate_hash_key(board);
+    board->pawn_key = generate_pawn_key(board);
+    board->material_key = generate_material_key(board);
+    compute_piece_scores(board, &board->scores);
+    if (nnue_enabled) {
+        refresh_accumulators(board);
+    }
     i++;
 }
 
@@ -0,0 +1,231 @@
+#include <stdlib.h>
+
+#include "endgame.h"
+#include "eval.h"
+
+#ifdef USE_GENERATED_TABLES
+#include "generated_endgames.h"
+#else
+Bitboard kpk_bitbase[KPK_SIZE / 64];
+#endif
+
+#define FILE_OF(square) ((square) & 7)
+#define ROW_OF(square) ((square) >> 3)
+
+// Number of king moves between two squares
+static inline int distance(int a, int b) {
+    int files = abs(FILE_OF(a) - FILE_OF(b));
+    int rows = abs(ROW_OF(a) - ROW_OF(b));
+    return files > rows ? files : rows;
+}
+
+// Distance of a square from the nearest edge: 0 on the edge, 3 in the centre
+static inline int edge_distance(int square) {
+    int file = FILE_OF(square) < 4 ? FILE_OF(square) : 7 - FILE_OF(square);
+    int row = ROW_OF(square) < 4 ? ROW_OF(square) : 7 - ROW_OF(square);
+    return file < row ? file : row;
+}
+
+// Bonuses for driving the defending king to the edge and bringing the attacking king next to it
+static inline int push_to_edge(int square) {
+    return 30 * (3 - edge_distance(square));
+}
+
+static inline int push_close(int a, int b) {
+    return 20 * (7 - distance(a, b));
+}
+
+static inline int kpk_index(int side, int white_king, int black_king, int pawn) {
+    return white_king | black_king << 6 | side << 12 | FILE_OF(pawn) << 13 | (ROW_OF(pawn) - 1) << 15;
+}
+
+/**
+ * Returns 1 when the side with the pawn wins. Squares are given as they are on the board,
+ * and the position is mirrored to the stored white pawn on the a-d files.
+ */
+int kpk_win(int strong_side, int strong_king, int pawn, int weak_king, int strong_to_move) {
+    if (strong_side == BLACK) {
+        strong_king ^= 56;
+        pawn ^= 56;
+        weak_king ^= 56;
+    }
+    if (FILE_OF(pawn) > 3) {
+        strong_king ^= 7;
+        pawn ^= 7;
+        weak_king ^= 7;
+    }
+    int index = kpk_index(strong_to_move ? WHITE : BLACK, strong_king, weak_king, pawn);
+    return (kpk_bitbase[index >> 6] >> (index & 63)) & 1;
+}
+
+#ifndef USE_GENERATED_TABLES
+/*
+ The bitbase is built by retrograde analysis. Positions that are illegal, immediately won by a safe promotion,
+ or immediately drawn by stalemate or the pawn being taken are classified first. The rest are classified from
+ their successors until nothing changes: white wins if any move reaches a win, black draws if any move reaches a draw.
+ The results are flags so the successors of a position can be combined with a single or.
+*/
+enum { KPK_INVALID = 0, KPK_UNKNOWN = 1, KPK_DRAW = 2, KPK_WIN = 4 };
+
+static int kpk_initial(int index) {
+    int white_king = index & 63;
+    int black_king = (index >> 6) & 63;
+    int side = (index >> 12) & 1;
+    int pawn = (((index >> 15) + 1) << 3) | ((index >> 13) & 3);
+    Bitboard black_king_bb = 1ULL << black_king;
+
+    if (white_king == black_king || white_king == pawn || black_king == pawn
+        || (king_attacks[white_king] & black_king_bb)
+        || (side == WHITE && (pawn_attacks[WHITE][pawn] & black_king_bb))) {
+        return KPK_INVALID;
+    }
+
+    if (side == WHITE) {
+        // The pawn promotes and the queen cannot be taken
+        int promotion = pawn - 8;
+        if (ROW_OF(pawn) == 1 && promotion != white_king && promotion != black_king
+            && (distance(black_king, promotion) > 1 || distance(white_king, promotion) == 1)) {
+            return KPK_WIN;
+        }
+    } else {
+        Bitboard guarded = king_attacks[white_king] | pawn_attacks[WHITE][pawn];
+        // Stalemate, or the black king takes the undefended pawn
+        if ((king_attacks[black_king] & ~guarded) == 0
+            || (king_attacks[black_king] & ~king_attacks[white_king] & (1ULL << pawn))) {
+            return KPK_DRAW;
+        }
+    }
+    return KPK_UNKNOWN;
+}
+
+static int kpk_classify(const unsigned char *results, int index) {
+    int white_king = index & 63;
+    int black_king = (index >> 6) & 63;
+    int side = (index >> 12) & 1;
+    int pawn = (((index >> 15) + 1) << 3) | ((index >> 13) & 3);
+
+    int good = side == WHITE ? KPK_WIN : KPK_DRAW;
+    int bad = side == WHITE ? KPK_DRAW : KPK_WIN;
+    int result = KPK_INVALID;
+
+    Bitboard moves = king_attacks[side == WHITE ? white_king : black_king];
+    while (moves) {
+        int target = get_least_sig_bit_index(moves);
+        result |= side == WHITE
+            ? results[kpk_index(BLACK, target, black_king, pawn)]
+            : results[kpk_index(WHITE, white_king, target, pawn)];
+        POP_BIT(moves, target);
+    }
+
+    // Pawn pushes. Promotions were classified by kpk_initial().
+    if (side == WHITE && ROW_OF(pawn) > 1) {
+        result |= results[kpk_index(BLACK, white_king, black_king, pawn - 8)];
+        if (ROW_OF(pawn) == 6 && pawn - 8 != white_king && pawn - 8 != black_king) {
+            result |= results[kpk_index(BLACK, white_king, black_king, pawn - 16)];
+        }
+    }
+
+    if (result & good) {
+        return good;
+    }
+    return (result & KPK_UNKNOWN) ? KPK_UNKNOWN : bad;
+}
+
+void init_kpk_bitbase() {
+    unsigned char *results = malloc(KPK_SIZE);
+    if (results == NULL) {
+        return;
+    }
+    for (int index = 0; index < KPK_SIZE; index++) {
+        results[index] = kpk_initial(index);
+    }
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int index = 0; index < KPK_SIZE; index++) {
+            if (results[index] == KPK_UNKNOWN) {
+                results[index] = kpk_classify(results, index);
+                changed |= results[index] != KPK_UNKNOWN;
+            }
+        }
+    }
+
+    memset(kpk_bitbase, 0, sizeof(kpk_bitbase));
+    for (int index = 0; index < KPK_SIZE; index++) {
+        if (results[index] == KPK_WIN) {
+            kpk_bitbase[index >> 6] |= 1ULL << (index & 63);
+        }
+    }
+    free(results);
+}
+#endif
+
+static inline int king_square(Board *board, int side) {
+    return get_least_sig_bit_index(board->bitboards[side == WHITE ? K : k]);
+}
+
+// King and pawn against king: drawn or won exactly by the bitbase. Wins prefer advanced pawns.
+int evaluate_kpk(Board *board, int strong_side) {
+    int pawn = get_least_sig_bit_index(board->bitboards[strong_side == WHITE ? P : p]);
+    int strong_king = king_square(board, strong_side);
+    int weak_king = king_square(board, strong_side ^ 1);
+
+    if (!kpk_win(strong_side, strong_king, pawn, weak_king, board->side == strong_side)) {
+        return 0;
+    }
+    int rank = strong_side == WHITE ? 7 - ROW_OF(pawn) : ROW_OF(pawn);
+    return KNOWN_WIN + MATERIAL_SCORE[P] + 10 * rank;
+}
+
+// King and rook against king: drive the defending king to the edge with the attacking king close by
+int evaluate_krk(Board *board, int strong_side) {
+    int strong_king = king_square(board, strong_side);
+    int weak_king = king_square(board, strong_side ^ 1);
+    return KNOWN_WIN + MATERIAL_SCORE[R] + push_to_edge(weak_king) + push_close(strong_king, weak_king);
+}
+
+/**
+ * King, bishop and knight against king: mate is only possible in a corner of the bishop's colour,
+ * so the defending king is driven towards the nearest of those two corners.
+ */
+int evaluate_kbnk(Board *board, int strong_side) {
+    int strong_king = king_square(board, strong_side);
+    int weak_king = king_square(board, strong_side ^ 1);
+    int bishop = get_least_sig_bit_index(board->bitboards[strong_side == WHITE ? B : b]);
+
+    // a8 is a light square. Light squares have an even file + row.
+    int light_bishop = (FILE_OF(bishop) + ROW_OF(bishop)) % 2 == 0;
+    int corner_a = light_bishop ? a8 : a1;
+    int corner_b = light_bishop ? h1 : h8;
+    int corner_distance = distance(weak_king, corner_a) < distance(weak_king, corner_b)
+        ? distance(weak_king, corner_a) : distance(weak_king, corner_b);
+
+    return KNOWN_WIN + MATERIAL_SCORE[B] + MATERIAL_SCORE[N]
+        + 40 * (7 - corner_distance) + push_to_edge(weak_king) + push_close(strong_king, weak_king);
+}
+
+/**
+ * Returns the evaluator for a material combination with a specialized endgame, or NULL.
+ * Only positions where one side has a bare king are handled. The side with the material is stored in strong_side.
+ */
+EndgameFunction find_endgame(Board *board, int *strong_side) {
+    for (int side = WHITE; side <= BLACK; side++) {
+        if (count_bits(board->occupancies[side ^ 1]) != 1) {
+            continue;
+        }
+        int offset = side == WHITE ? 0 : 6;
+        int pieces = count_bits(board->occupancies[side]) - 1;
+        *strong_side = side;
+        if (pieces == 1 && board->bitboards[P + offset]) {
+            return evaluate_kpk;
+        }
+        if (pieces == 1 && board->bitboards[R + offset]) {
+            return evaluate_krk;
+        }
+        if (pieces == 2 && board->bitboards[B + offset] && board->bitboards[N + offset]) {
+            return evaluate_kbnk;
+        }
+    }
+    return NULL;
+}
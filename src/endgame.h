@@ -0,0 +1,35 @@
+#ifndef ENDGAME_H
+#define ENDGAME_H
+
+#include "bitboard.h"
+
+// Score of a position that is won without search, below any mate score so the search still prefers a forced mate
+#define KNOWN_WIN 10000
+
+/*
+ KPK bitbase: one bit per position of king and pawn against king, set when the side with the pawn wins.
+ Positions are stored with the pawn side as white and the pawn on the a-d files, and indexed by
+ white king | black king << 6 | side to move << 12 | pawn file << 13 | (pawn row - 1) << 15.
+*/
+#define KPK_SIZE (2 * 24 * 64 * 64)
+
+/**
+ * Specialized evaluators for endgames the general evaluation plays badly or cannot tell apart from a draw.
+ * They are selected by the material table, take the side with the material advantage,
+ * and return the score from that side's point of view.
+ */
+typedef int (*EndgameFunction)(Board*, int);
+
+int evaluate_kpk(Board*, int);
+int evaluate_krk(Board*, int);
+int evaluate_kbnk(Board*, int);
+EndgameFunction find_endgame(Board*, int*);
+int kpk_win(int, int, int, int, int);
+
+#ifndef USE_GENERATED_TABLES
+void init_kpk_bitbase();
+#endif
+
+extern TABLE_CONST Bitboard kpk_bitbase[KPK_SIZE / 64];
+
+#endif
@@ -1,25 +1,25 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 
 #include "eval.h"
 #include "bitboard.h"
+#include "board.h"
 #include "move.h"
+#include "table.h"
+#include "endgame.h"
+#include "nnue.h"
 
 #define MIRROR(square) ((square) ^ 56)
 #define FILE_ABC_MASK 0x0707070707070707ULL
 #define FILE_FGH_MASK 0xE0E0E0E0E0E0E0E0ULL
+#define FILE_A_MASK 0x0101010101010101ULL
+#define FILE_H_MASK 0x8080808080808080ULL
+#define LAZY_EVAL_NONE INT_MAX // Bound of the window evaluate() passes, which is never estimated
+
+_Thread_local unsigned long long lazy_evals, lazy_exits;
 
-struct {
-    int phase;
-    int material[2];
-    int openingPST[2];
-    int endgamePST[2];
-    int openingMobility[2];
-    int endgameMobility[2];
-    int pawnStructure[2];
-    int materialAdj[2];
-    int kingSafety[2];
-    int positionMetrics[2];
-} Score;
 
 /***** Position *****
  * These tables define bonuses (or penalties) for piece position.
@@ -291,12 +291,6 @@ enum {PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING};
 static const int KNIGHT_ADJ[9] = { -20, -16, -12, -8, -4,  0,  4,  8, 12 };
 static const int ROOK_ADJ[9] = { 15,  12,   9,  6,  3,  0, -3, -6, -9 };
 
-static const int DOUBLE_PAWN_PENALTY = -20;
-static const int ISOLATED_PAWN_PENALTY = -15;
-
-// Passed pawn scores indexed by the rank.
-static const int PASSED_PAWN_BONUS[8] = { 0, 10, 20, 40, 60, 80, 100, 200 }; 
-
 static const int HALF_OPEN_FILE_SCORE = 5;
 static const int OPEN_FILE_SCORE = 10;
 
@@ -307,12 +301,25 @@ static const int KNIGHT_PAIR_PENALTY = -8;
 static const int BISHOP_ENDGAME_BONUS = 1;
 static const int KNIGHT_BLOCK_C3_PENALTY = -10;
 static const int QUEEN_DEVELOPMENT_PENALTY = -2;
+static const int HANGING_PIECE_PENALTY = -15;
+
+// Penalties for each square next to the king attacked by an opponent piece
+static const int MINOR_KING_ZONE_ATTACK = 3;
+static const int ROOK_KING_ZONE_ATTACK = 4;
+static const int QUEEN_KING_ZONE_ATTACK = 6;
 
 // Phase values
 static const int MINOR_PHASE_VALUE = 1;
 static const int ROOK_PHASE_VALUE = 2;
 static const int QUEEN_PHASE_VALUE = 4; 
 
+// Mobility weights per attacked square
+static const PackedScore KNIGHT_MOBILITY = PACK_SCORE(4, 4);
+static const PackedScore BISHOP_MOBILITY = PACK_SCORE(3, 3);
+static const PackedScore ROOK_MOBILITY = PACK_SCORE(2, 4);
+static const PackedScore QUEEN_MOBILITY = PACK_SCORE(1, 2);
+static const PackedScore KING_MOBILITY = PACK_SCORE(0, 1);
+
 // Mobility adjustments
 static const int KIGHT_MOB_ADJ = 4;
 static const int BISHOP_MOB_ADJ = 7;
@@ -320,11 +327,15 @@ static const int ROOK_MOB_ADJ = 7;
 static const int QUEEN_MOB_ADJ = 14;
 static const int KING_MOB_ADJ = 1;
 
-Bitboard file_masks[64];
+// Piece phase values indexed by piece. Pawns and kings do not count towards the phase.
+const int PIECE_PHASE[12] = {
+    0, MINOR_PHASE_VALUE, MINOR_PHASE_VALUE, ROOK_PHASE_VALUE, QUEEN_PHASE_VALUE, 0,
+    0, MINOR_PHASE_VALUE, MINOR_PHASE_VALUE, ROOK_PHASE_VALUE, QUEEN_PHASE_VALUE, 0,
+};
+
+PackedScore piece_square[12][64];
+
 Bitboard rank_masks[64];
-Bitboard isolated_masks[64];
-Bitboard white_passed_masks[64];
-Bitboard black_passed_masks[64];
 
 Bitboard set_masks(int file, int rank) {
     Bitboard mask = 0ULL;
@@ -347,319 +358,463 @@ void init_evaluation_masks() {
     for (int r = 0; r < 8; r++) {
         for (int f = 0; f < 8; f++) {
             int square = SQUARE_INDEX(r, f);
-            file_masks[square] |= set_masks(f, -1);
             rank_masks[square] |= set_masks(-1, r);
+        }
+    }
 
-            isolated_masks[square] |= set_masks(f-1, -1);
-            isolated_masks[square] |= set_masks(f+1, -1);
+    // The material is folded into the piece-square values. Black uses the white tables mirrored vertically.
+    const int *opening_tables[6] = { PAWN_OPENING_POSITION, KNIGHT_OPENING_POSITION, BISHOP_OPENING_POSITION, ROOK_OPENING_POSITION, QUEEN_OPENING_POSITION, KING_OPENING_POSITION };
+    const int *endgame_tables[6] = { PAWN_ENDGAME_POSITION, KNIGHT_ENDGAME_POSITION, BISHOP_ENDGAME_POSITION, ROOK_ENDGAME_POSITION, QUEEN_ENDGAME_POSITION, KING_ENDGAME_POSITION };
+    for (int piece = PAWN; piece <= KING; piece++) {
+        for (int square = 0; square < 64; square++) {
+            int material = MATERIAL_SCORE[piece];
+            piece_square[piece][square] = PACK_SCORE(material + opening_tables[piece][square], material + endgame_tables[piece][square]);
+            piece_square[piece + 6][square] = PACK_SCORE(material + opening_tables[piece][MIRROR(square)], material + endgame_tables[piece][MIRROR(square)]);
+        }
+    }
+}
 
-            white_passed_masks[square] |= set_masks(f - 1, -1);
-            white_passed_masks[square] |= set_masks(f, -1);
-            white_passed_masks[square] |= set_masks(f + 1, -1);
+// Returns the material score for the given side
+int get_material(Board *board, int side) {
+    return board->scores.material[side];
+}
 
-            black_passed_masks[square] |= set_masks(f - 1, -1);
-            black_passed_masks[square] |= set_masks(f, -1);
-            black_passed_masks[square] |= set_masks(f + 1, -1);
+// Sums the material, phase and piece-square scores from scratch. Used when a position is set up, and to check the incremental scores.
+void compute_piece_scores(Board *board, PieceScores *scores) {
+    memset(scores, 0, sizeof(PieceScores));
+    for (int piece = P; piece <= k; piece++) {
+        Bitboard bitboard = board->bitboards[piece];
+        while (bitboard) {
+            int square = get_least_sig_bit_index(bitboard);
+            add_piece_score(scores, piece, square);
+            POP_BIT(bitboard, square);
         }
     }
+}
 
-    for (int r = 0; r < 8; r++) {
-        for (int f = 0; f < 8; f++) {
-            int square = SQUARE_INDEX(r, f);
-            for (int i = 0; i < (8 - r); i++) {
-                white_passed_masks[square] &= ~rank_masks[(7 - i) * 8 + f]; 
+#ifdef DEBUG
+// Debug builds verify the incremental scores against a full recompute at every evaluation
+static void check_piece_scores(Board *board) {
+    PieceScores scores;
+    compute_piece_scores(board, &scores);
+    if (memcmp(&scores, &board->scores, sizeof(PieceScores)) != 0) {
+        printf("    [ERROR] Incremental piece scores do not match the position!\n");
+        print_board(board);
+        exit(EXIT_FAILURE);
+    }
+}
+#endif
+
+// The set bits and every square north of them, towards rank 8
+static inline Bitboard north_fill(Bitboard bitboard) {
+    bitboard |= bitboard >> 8;
+    bitboard |= bitboard >> 16;
+    return bitboard | bitboard >> 32;
+}
+
+// The set bits and every square south of them, towards rank 1
+static inline Bitboard south_fill(Bitboard bitboard) {
+    bitboard |= bitboard << 8;
+    bitboard |= bitboard << 16;
+    return bitboard | bitboard << 32;
+}
+
+// Every square on the files of the set bits
+static inline Bitboard file_fill(Bitboard bitboard) {
+    return north_fill(bitboard) | south_fill(bitboard);
+}
+
+static inline Bitboard east_one(Bitboard bitboard) {
+    return (bitboard << 1) & ~FILE_A_MASK;
+}
+
+static inline Bitboard west_one(Bitboard bitboard) {
+    return (bitboard >> 1) & ~FILE_H_MASK;
+}
+
+/**
+ * Scores the pawn structure of both sides: doubled, isolated and passed pawns.
+ * Everything stored in the entry depends only on the pawns, so it can be cached by the pawn hash key.
+ * Each term is found for all the pawns of a side at once with file fills and shifts, then counted.
+ */
+void evaluate_pawns(Board *board, PawnEntry *entry) {
+    entry->key = board->pawn_key;
+    for (int side = WHITE; side <= BLACK; side++) {
+        Bitboard own_pawns = board->bitboards[side == WHITE ? P : p];
+        Bitboard opponent_pawns = board->bitboards[side == WHITE ? p : P];
+        Bitboard pawn_files = file_fill(own_pawns);
+
+        /*
+            A file with n pawns is penalized n * n times: once for each of its pawns, and twice for each pair of them.
+            Pairs are counted by shifting the pawns one rank at a time and matching them against themselves.
+        */
+        Bitboard doubled = own_pawns & ((north_fill(own_pawns) >> 8) | (south_fill(own_pawns) << 8));
+        int pairs = 0;
+        for (Bitboard ahead = own_pawns >> 8; ahead; ahead >>= 8) {
+            pairs += count_bits(own_pawns & ahead);
+        }
+        entry->score[side] = (count_bits(doubled) + 2 * pairs) * DOUBLE_PAWN_PENALTY;
+
+        // Isolated pawns have no pawns of their side on the adjacent files
+        Bitboard isolated = own_pawns & ~(east_one(pawn_files) | west_one(pawn_files));
+        entry->score[side] += count_bits(isolated) * ISOLATED_PAWN_PENALTY;
+
+        // Passed pawns have no opponent pawns in front of them on their own or the adjacent files
+        Bitboard stoppers = opponent_pawns | east_one(opponent_pawns) | west_one(opponent_pawns);
+        Bitboard stopped = side == WHITE ? south_fill(stoppers) << 8 : north_fill(stoppers) >> 8;
+        Bitboard passed = own_pawns & ~stopped;
+        for (int row = 0; row < 8 && passed; row++) {
+            int rank = side == WHITE ? 7 - row : row;
+            entry->score[side] += count_bits(passed & (0xFFULL << (8 * row))) * PASSED_PAWN_BONUS[rank];
+        }
+        entry->passed[side] = passed;
+        entry->semi_open[side] = ~pawn_files;
+    }
+}
+
+/**
+ * Builds the attacks of both sides and their mobility. Knights and kings count the squares not taken by their own pieces,
+ * while sliders count every square they reach, own pieces included.
+ */
+void build_attack_map(Board *board, AttackMap *attacks) {
+    Bitboard occupancy = board->occupancies[BOTH];
+    for (int side = WHITE; side <= BLACK; side++) {
+        int offset = side == WHITE ? 0 : 6;
+        Bitboard own_pieces = board->occupancies[side];
+        Bitboard knights = 0ULL, bishops = 0ULL, rooks = 0ULL, queens = 0ULL, king = 0ULL;
+        PackedScore mobility = 0;
+
+        // The maps are kept in locals until the end. Stores through attacks could alias the board, forcing its bitboards to be reloaded.
+        Bitboard bitboard = board->bitboards[N + offset];
+        while (bitboard) {
+            int square = get_least_sig_bit_index(bitboard);
+            Bitboard reach = knight_attacks[square];
+            knights |= reach;
+            mobility += KNIGHT_MOBILITY * count_bits(reach & ~own_pieces);
+            POP_BIT(bitboard, square);
+        }
+        bitboard = board->bitboards[B + offset];
+        while (bitboard) {
+            int square = get_least_sig_bit_index(bitboard);
+            Bitboard reach = get_bishop_attacks(square, occupancy);
+            bishops |= reach;
+            mobility += BISHOP_MOBILITY * count_bits(reach);
+            POP_BIT(bitboard, square);
+        }
+        bitboard = board->bitboards[R + offset];
+        while (bitboard) {
+            int square = get_least_sig_bit_index(bitboard);
+            Bitboard reach = get_rook_attacks(square, occupancy);
+            rooks |= reach;
+            mobility += ROOK_MOBILITY * count_bits(reach);
+            POP_BIT(bitboard, square);
+        }
+        bitboard = board->bitboards[Q + offset];
+        while (bitboard) {
+            int square = get_least_sig_bit_index(bitboard);
+            Bitboard reach = get_queen_attacks(square, occupancy);
+            queens |= reach;
+            mobility += QUEEN_MOBILITY * count_bits(reach);
+            POP_BIT(bitboard, square);
+        }
+        bitboard = board->bitboards[K + offset];
+        while (bitboard) {
+            int square = get_least_sig_bit_index(bitboard);
+            king |= king_attacks[square];
+            mobility += KING_MOBILITY * count_bits(king_attacks[square] & ~own_pieces);
+            POP_BIT(bitboard, square);
+        }
+
+        Bitboard pushed = side == WHITE ? board->bitboards[P] >> 8 : board->bitboards[p] << 8;
+        Bitboard pawns = east_one(pushed) | west_one(pushed);
+
+        Bitboard *by_piece = attacks->by_piece[side];
+        by_piece[PAWN] = pawns;
+        by_piece[KNIGHT] = knights;
+        by_piece[BISHOP] = bishops;
+        by_piece[ROOK] = rooks;
+        by_piece[QUEEN] = queens;
+        by_piece[KING] = king;
+        attacks->all[side] = pawns | knights | bishops | rooks | queens | king;
+        attacks->mobility[side] = mobility;
+    }
+}
+
+/**
+ * Fills in the terms that depend only on the piece counts: the piece values adjusted for the side's own pawns,
+ * the piece pairs, how far the score is scaled down when the side ahead has too little to win, and the specialized endgame.
+ */
+static void evaluate_material(Board *board, MaterialEntry *entry) {
+    entry->key = board->material_key;
+    int pawns[2] = { count_bits(board->bitboards[P]), count_bits(board->bitboards[p]) };
+
+    for (int side = WHITE; side <= BLACK; side++) {
+        int offset = side == WHITE ? 0 : 6;
+        int knights = count_bits(board->bitboards[N + offset]);
+        int bishops = count_bits(board->bitboards[B + offset]);
+        int rooks = count_bits(board->bitboards[R + offset]);
+
+        entry->imbalance[side] = knights * KNIGHT_ADJ[pawns[side]] + rooks * ROOK_ADJ[pawns[side]];
+        if (bishops > 1) {
+            entry->imbalance[side] += BISHOP_PAIR_BONUS;
+        }
+        if (knights > 1) {
+            entry->imbalance[side] += pawns[WHITE] + pawns[BLACK] > 10 ? KNIGHT_PAIR_BONUS : KNIGHT_PAIR_PENALTY;
+        }
+
+        /*                                                                  
+            Account of low material situations. Without this, the engine will think it is leading when it has insufficient material.
+
+            - 1 Minor cannot win                               
+            - 2 knights cannot win                      
+            - Rook vs Minor is drawish                           
+            - Rook + Minor vs Rook is drawish                        
+        */
+        int leading = board->scores.material[side];
+        int trailing = board->scores.material[side ^ 1];
+        entry->scale[side] = 2;
+        if (pawns[side] == 0) {
+
+            // Cases where it is impossible to win with no pawns
+            if (leading < 400 || (pawns[BLACK] == 0 && trailing == 2 * MATERIAL_SCORE[N])) {
+                entry->scale[side] = 0;
             }
-            for (int i = 0; i < r + 1; i++) {
-                black_passed_masks[square] &= ~rank_masks[i * 8 + f];
+
+            // Cases where it is possible, but very unlikely to win with no pawns
+            else if ((leading == MATERIAL_SCORE[ROOK] && trailing == MATERIAL_SCORE[BISHOP])
+                || (leading == MATERIAL_SCORE[ROOK] && trailing == MATERIAL_SCORE[KNIGHT])
+                || (leading == MATERIAL_SCORE[ROOK] + MATERIAL_SCORE[BISHOP] && trailing == MATERIAL_SCORE[ROOK])
+                || (leading == MATERIAL_SCORE[ROOK] + MATERIAL_SCORE[KNIGHT] && trailing == MATERIAL_SCORE[ROOK])) {
+                entry->scale[side] = 1;
             }
         }
     }
+
+    entry->endgame = find_endgame(board, &entry->strong_side);
 }
 
-static const int square_to_rank[64] = {
-    7, 7, 7, 7, 7, 7, 7, 7,
-    6, 6, 6, 6, 6, 6, 6, 6,
-    5, 5, 5, 5, 5, 5, 5, 5,
-    4, 4, 4, 4, 4, 4, 4, 4,
-    3, 3, 3, 3, 3, 3, 3, 3,
-    2, 2, 2, 2, 2, 2, 2, 2,
-    1, 1, 1, 1, 1, 1, 1, 1,
-	0, 0, 0, 0, 0, 0, 0, 0
-};
+static int evaluate_position(Board*, EvalTrace*, int, int, int*);
 
-// Returns the last evaluated material score for the given side.
-// If both sides have 0 material and the phase is > 0, then the material has not been calculated yet.
-// The caller should ensure that material has been calculated before calling this function.
-int get_material(int side) {
-    if (Score.material[WHITE] == 0 && Score.material[BLACK] == 0 && Score.phase > 0) {
-        printf("    [ERROR] Material has not been calculated yet!\n");
-        return 0; // Return 0 or some default value indicating an error
+// Returns the static evaluation from the side to move's point of view, from the evaluation cache when possible.
+// The network is used when one is loaded, and the classical evaluation otherwise.
+int evaluate(Board *board) {
+#ifdef DEBUG
+    check_piece_scores(board);
+#endif
+    int score;
+    if (probe_eval_cache(board->hash_key, &score)) {
+        return score;
     }
-    return Score.material[side];
+    EvalTrace trace;
+    score = nnue_enabled ? nnue_evaluate(board) : evaluate_position(board, &trace, -LAZY_EVAL_NONE, LAZY_EVAL_NONE, NULL);
+    store_eval_cache(board->hash_key, score);
+    return score;
 }
 
-int evaluate(Board *board) {
+/**
+ * Like evaluate(), but only needs to know how the score compares to the window [alpha, beta].
+ * When the material, piece-square, imbalance and pawn structure scores alone are more than LAZY_EVAL_MARGIN outside the window,
+ * that estimate is returned without computing the attacks, mobility, king safety and threats.
+ * Estimates are not stored in the evaluation cache.
+ */
+int evaluate_lazy(Board *board, int alpha, int beta) {
+#ifdef DEBUG
+    check_piece_scores(board);
+#endif
+    int score;
+    if (probe_eval_cache(board->hash_key, &score)) {
+        return score;
+    }
+    if (nnue_enabled) {
+        score = nnue_evaluate(board);
+        store_eval_cache(board->hash_key, score);
+        return score;
+    }
+
+    EvalTrace trace;
+    int estimated = 0;
+    lazy_evals++;
+    score = evaluate_position(board, &trace, alpha - LAZY_EVAL_MARGIN, beta + LAZY_EVAL_MARGIN, &estimated);
+    if (estimated) {
+        lazy_exits++;
+    } else {
+        store_eval_cache(board->hash_key, score);
+    }
+    return score;
+}
+
+// Returns the classical evaluation from the side to move's point of view and fills in the trace with its terms.
+// The evaluation cache is not used. Terms a specialized endgame skips are left at 0.
+int trace_evaluation(Board *board, EvalTrace *trace) {
+    memset(trace, 0, sizeof(EvalTrace));
+    return evaluate_position(board, trace, -LAZY_EVAL_NONE, LAZY_EVAL_NONE, NULL);
+}
+
+/**
+ * The classical evaluation. Every term is written to the caller's trace, and nothing else is kept between calls,
+ * so the score depends only on the board. When estimated is not NULL the cheap terms are summed first,
+ * and if they put the score outside [lazy_alpha, lazy_beta] that estimate is returned and estimated is set.
+ * A trace is only complete when the full evaluation ran: neither a lazy exit nor a specialized endgame fills it in.
+ */
+static int evaluate_position(Board *board, EvalTrace *trace, int lazy_alpha, int lazy_beta, int *estimated) {
+    // Material, phase and piece-square scores are kept up to date by make_move()
+    trace->phase = board->scores.phase;
+    trace->material[WHITE] = board->scores.material[WHITE];
+    trace->material[BLACK] = board->scores.material[BLACK];
+    trace->psq[WHITE] = board->scores.psq[WHITE];
+    trace->psq[BLACK] = board->scores.psq[BLACK];
+
     // Clear the scores
-    Score.phase = 0;
-    Score.material[WHITE] = 0;
-    Score.material[BLACK] = 0;
-    Score.openingPST[WHITE] = 0;
-    Score.openingPST[BLACK] = 0;
-    Score.endgamePST[WHITE] = 0;
-    Score.endgamePST[BLACK] = 0;
-    Score.openingMobility[WHITE] = 0;
-    Score.openingMobility[BLACK] = 0;
-    Score.endgameMobility[WHITE] = 0;
-    Score.endgameMobility[BLACK] = 0;
-    Score.pawnStructure[WHITE] = 0;
-    Score.pawnStructure[BLACK] = 0;
-    Score.materialAdj[WHITE] = 0;
-    Score.materialAdj[BLACK] = 0;
-    Score.kingSafety[WHITE] = 0;
-    Score.kingSafety[BLACK] = 0;
-    Score.positionMetrics[WHITE] = 0;
-    Score.positionMetrics[BLACK] = 0;
-
-    // Keep track of mobility
-    int wBishopMob = 0;
-    int bBishopMob = 0;
-    int wKnightMob = 0;
-    int bKnightMob = 0;
-    int wRookMob = 0;
-    int bRookMob = 0;
-    int wQueenMob = 0;
-    int bQueenMob = 0;
-    int wKingMob = 0;
-    int bKingMob = 0;
-
-    int wPawns = count_bits(board->bitboards[P]);
-    int bPawns = count_bits(board->bitboards[p]);
+    trace->kingSafety[WHITE] = 0;
+    trace->kingSafety[BLACK] = 0;
+    trace->threats[WHITE] = 0;
+    trace->threats[BLACK] = 0;
+    trace->positionMetrics[WHITE] = 0;
+    trace->positionMetrics[BLACK] = 0;
+
+    // Material terms, from the material table when the thread has one
+    MaterialEntry local_material;
+    MaterialEntry *material_entry = material_table ? get_material_entry(board) : &local_material;
+    if (material_entry == &local_material || material_entry->key != board->material_key) {
+        evaluate_material(board, material_entry);
+    }
 
-    for (int piece = P; piece <= k; piece++) {
-        Bitboard bitboard = board->bitboards[piece];
-        while (bitboard) {
-            int square = get_least_sig_bit_index(bitboard);
-            int mirror_square = MIRROR(square);
-            int double_pawns = 0;
-
-            // Position
-            switch (piece) {
-                case P:
-                    Score.material[WHITE] += MATERIAL_SCORE[PAWN];
-                    Score.openingPST[WHITE] += PAWN_OPENING_POSITION[square];
-                    Score.endgamePST[WHITE] += PAWN_ENDGAME_POSITION[square];
-                    double_pawns = count_bits(board->bitboards[P] & file_masks[square]);
-                    if (double_pawns > 1) {
-                        Score.pawnStructure[WHITE] += double_pawns * DOUBLE_PAWN_PENALTY;
-                    }
-                    if ((board->bitboards[P] & isolated_masks[square]) == 0) {
-                        Score.pawnStructure[WHITE] += ISOLATED_PAWN_PENALTY;
-                    }
-                    if ((white_passed_masks[square] & board->bitboards[p]) == 0) {
-                        Score.pawnStructure[WHITE] += PASSED_PAWN_BONUS[square_to_rank[square]];
-                    }
-                    break;
-                case N: 
-                    Score.phase += MINOR_PHASE_VALUE;
-                    Score.material[WHITE] += MATERIAL_SCORE[KNIGHT];
-                    Score.materialAdj[WHITE] += KNIGHT_ADJ[wPawns];
-                    Score.openingPST[WHITE] += KNIGHT_OPENING_POSITION[square];
-                    Score.endgamePST[WHITE] += KNIGHT_ENDGAME_POSITION[square];
-                    wKnightMob += count_bits(board->knight_attacks[square] & (~board->occupancies[WHITE]));
-                    
-                    // If there is a pawn on c2 and a knight on c3, the knight gets a penalty of 5 
-                    if (square == c3 && (board->bitboards[P] & c2) && (board->bitboards[P] & d4) && !(board->bitboards[P] & e4)) {
-                        Score.positionMetrics[WHITE] += KNIGHT_BLOCK_C3_PENALTY;
-                    }
-                    break;
-                case B: 
-                    Score.phase += MINOR_PHASE_VALUE;
-                    Score.material[WHITE] += MATERIAL_SCORE[BISHOP];
-                    Score.openingPST[WHITE] += BISHOP_OPENING_POSITION[square];
-                    Score.endgamePST[WHITE] += BISHOP_ENDGAME_POSITION[square];
-                    wBishopMob += count_bits(get_bishop_attacks(square, board->occupancies[BOTH], board));
-                    break;
-                case R:
-                    Score.phase += ROOK_PHASE_VALUE;
-                    Score.material[WHITE] += MATERIAL_SCORE[ROOK];
-                    Score.materialAdj[WHITE] += ROOK_ADJ[wPawns];
-                    Score.openingPST[WHITE] += ROOK_OPENING_POSITION[square];
-                    Score.endgamePST[WHITE] += ROOK_ENDGAME_POSITION[square];
-                    // Bonus for rooks on open and half-open files
-                    if ((board->bitboards[P] & file_masks[square]) == 0) {
-                        Score.positionMetrics[WHITE] += HALF_OPEN_FILE_SCORE;
-                    }
-                    if (((board->bitboards[P] & file_masks[square]) | (board->bitboards[p] & file_masks[square])) == 0) {
-                        Score.positionMetrics[WHITE] += OPEN_FILE_SCORE;
-                    }
-                    wRookMob += count_bits(get_rook_attacks(square, board->occupancies[BOTH], board));
-                    break;
-                case Q:
-                    Score.phase += QUEEN_PHASE_VALUE;
-                    Score.material[WHITE] += MATERIAL_SCORE[QUEEN];
-                    Score.openingPST[WHITE] += QUEEN_OPENING_POSITION[square];
-                    Score.endgamePST[WHITE] += QUEEN_ENDGAME_POSITION[square];
-                    wQueenMob += count_bits(get_queen_attacks(square, board->occupancies[BOTH], board));
-                    
-                    // Prevent the queen from developing too early
-                    if (rank_masks[square] > 2) {
-                        if (board->bitboards[N] & b1) Score.positionMetrics[WHITE] += QUEEN_DEVELOPMENT_PENALTY; 
-                        if (board->bitboards[N] & g1) Score.positionMetrics[WHITE] += QUEEN_DEVELOPMENT_PENALTY; 
-                        if (board->bitboards[B] & c1) Score.positionMetrics[WHITE] += QUEEN_DEVELOPMENT_PENALTY; 
-                        if (board->bitboards[B] & f1) Score.positionMetrics[WHITE] += QUEEN_DEVELOPMENT_PENALTY;
-                    }
-                    break;
-                case K:
-                    Score.material[WHITE] += MATERIAL_SCORE[KING];
-                    Score.openingPST[WHITE] += KING_OPENING_POSITION[square];
-                    Score.endgamePST[WHITE] += KING_ENDGAME_POSITION[square];
-
-                    // Penalty for kings on exposed files
-                    if ((board->bitboards[P] & file_masks[square]) == 0) {
-                        Score.kingSafety[WHITE] -= HALF_OPEN_FILE_SCORE;
-                    }
-                    if (((board->bitboards[P] & file_masks[square]) | (board->bitboards[p] & file_masks[square])) == 0) {
-                        Score.kingSafety[WHITE] -= OPEN_FILE_SCORE;
-                    }
-                    
-                    // Pieces in front of king protecting it
-                    Score.kingSafety[WHITE] += count_bits(board->king_attacks[square] & board->occupancies[WHITE]) * KING_SAFETY_BONUS;
-                    wKingMob += count_bits(board->king_attacks[square] & (~board->occupancies[WHITE]));
-                    break;
-                case p:
-                    Score.material[BLACK] += MATERIAL_SCORE[PAWN];
-                    Score.openingPST[BLACK] += PAWN_OPENING_POSITION[mirror_square];
-                    Score.endgamePST[BLACK] += PAWN_ENDGAME_POSITION[mirror_square];
-                    double_pawns = count_bits(board->bitboards[p] & file_masks[square]);
-                    if (double_pawns > 1) {
-                        Score.pawnStructure[BLACK] += double_pawns * DOUBLE_PAWN_PENALTY;
-                    }
-                    if ((board->bitboards[p] & isolated_masks[square]) == 0) {
-                        Score.pawnStructure[BLACK] += ISOLATED_PAWN_PENALTY;
-                    }
-                    if ((black_passed_masks[square] & board->bitboards[P]) == 0) {
-                        Score.pawnStructure[BLACK] += PASSED_PAWN_BONUS[square_to_rank[mirror_square]];
-                    }
-                    break;
-                case n:
-                    Score.phase += MINOR_PHASE_VALUE;
-                    Score.material[BLACK] += MATERIAL_SCORE[KNIGHT];
-                    Score.materialAdj[BLACK] += KNIGHT_ADJ[bPawns];
-                    Score.openingPST[BLACK] += KNIGHT_OPENING_POSITION[mirror_square];
-                    Score.endgamePST[BLACK] += KNIGHT_ENDGAME_POSITION[mirror_square];
-                    bKnightMob += count_bits(board->knight_attacks[square] & (~board->occupancies[BLACK]));
-                    if (square == c6 && (board->bitboards[p] & c7) && (board->bitboards[p] & d5) && !(board->bitboards[p] & e5)) {
-                        Score.positionMetrics[BLACK] += KNIGHT_BLOCK_C3_PENALTY;
-                    }
-                    break;
-                case b:
-                    Score.phase += MINOR_PHASE_VALUE;
-                    Score.material[BLACK] += MATERIAL_SCORE[BISHOP];
-                    Score.openingPST[BLACK] += BISHOP_OPENING_POSITION[mirror_square]; 
-                    Score.endgamePST[BLACK] += BISHOP_ENDGAME_POSITION[mirror_square];
-                    bBishopMob += count_bits(get_bishop_attacks(square, board->occupancies[BOTH], board)); 
-                    break;
-                case r:
-                    Score.phase += ROOK_PHASE_VALUE;
-                    Score.material[BLACK] += MATERIAL_SCORE[ROOK];
-                    Score.materialAdj[BLACK] += ROOK_ADJ[bPawns];
-                    Score.openingPST[BLACK] += ROOK_OPENING_POSITION[mirror_square];
-                    Score.endgamePST[BLACK] += ROOK_ENDGAME_POSITION[mirror_square];
-
-                    // Bonus for rooks on open and half-open files
-                    if ((board->bitboards[p] & file_masks[square]) == 0) {
-                        Score.positionMetrics[BLACK] += HALF_OPEN_FILE_SCORE;
-                    }
-                    if (((board->bitboards[P] & file_masks[square]) | (board->bitboards[p] & file_masks[square])) == 0) {
-                        Score.positionMetrics[BLACK] += OPEN_FILE_SCORE;
-                    }
-                    bRookMob += count_bits(get_rook_attacks(square, board->occupancies[BOTH], board));
-                    break;
-                case q:
-                    Score.phase += QUEEN_PHASE_VALUE;
-                    Score.material[BLACK] += MATERIAL_SCORE[QUEEN];
-                    Score.openingPST[BLACK] += QUEEN_OPENING_POSITION[mirror_square];
-                    Score.endgamePST[BLACK] += QUEEN_ENDGAME_POSITION[mirror_square];
-                    bQueenMob += count_bits(get_queen_attacks(square, board->occupancies[BOTH], board));
-
-                    // Prevent the queen from developing too early
-                    if (rank_masks[square] < 7) {
-                        if (board->bitboards[N] & b8) Score.positionMetrics[BLACK] += QUEEN_DEVELOPMENT_PENALTY; 
-                        if (board->bitboards[N] & g8) Score.positionMetrics[BLACK] += QUEEN_DEVELOPMENT_PENALTY; 
-                        if (board->bitboards[B] & c8) Score.positionMetrics[BLACK] += QUEEN_DEVELOPMENT_PENALTY; 
-                        if (board->bitboards[B] & f8) Score.positionMetrics[BLACK] += QUEEN_DEVELOPMENT_PENALTY;
-                    }
-                    break;
-                case k:
-                    Score.material[BLACK] += MATERIAL_SCORE[KING];
-                    Score.openingPST[BLACK] += KING_OPENING_POSITION[mirror_square];
-                    Score.endgamePST[BLACK] += KING_ENDGAME_POSITION[mirror_square];
-
-                    // Penalty for kings on exposed files
-                    if ((board->bitboards[p] & file_masks[square]) == 0) {
-                        Score.kingSafety[BLACK] -= HALF_OPEN_FILE_SCORE;
-                    }
-                    if (((board->bitboards[P] & file_masks[square]) | (board->bitboards[p] & file_masks[square])) == 0) {
-                        Score.kingSafety[BLACK] -= OPEN_FILE_SCORE;
-                    }
-                    
-                    // Pieces in front of king protecting it
-                    Score.kingSafety[BLACK] += count_bits(board->king_attacks[square] & board->occupancies[BLACK]) * KING_SAFETY_BONUS;
-                    bKingMob += count_bits(board->king_attacks[square] & (~board->occupancies[BLACK]));
-                    break;
-            }
-            POP_BIT(bitboard, square);
+    // Known wins and draws do not need the general evaluation
+    if (material_entry->endgame) {
+        int score = material_entry->endgame(board, material_entry->strong_side);
+        return board->side == material_entry->strong_side ? score : -score;
+    }
+    trace->materialAdj[WHITE] = material_entry->imbalance[WHITE];
+    trace->materialAdj[BLACK] = material_entry->imbalance[BLACK];
+
+
+    // Pawn structure, from the pawn hash table when the thread has one
+    PawnEntry local_pawns;
+    PawnEntry *pawn_entry = pawn_table ? get_pawn_entry(board) : &local_pawns;
+    if (pawn_entry == &local_pawns || pawn_entry->key != board->pawn_key) {
+        evaluate_pawns(board, pawn_entry);
+    } else {
+        pawn_hits++;
+    }
+    trace->pawnStructure[WHITE] = pawn_entry->score[WHITE];
+    trace->pawnStructure[BLACK] = pawn_entry->score[BLACK];
+
+    // Lazy exit when the score is already decided without the attack based terms
+    if (estimated) {
+        int phase = trace->phase > 24 ? 24 : trace->phase;
+        PackedScore psq = trace->psq[WHITE] - trace->psq[BLACK];
+        int score = (opening_value(psq) * phase + endgame_value(psq) * (24 - phase)) / 24
+            + trace->pawnStructure[WHITE] - trace->pawnStructure[BLACK]
+            + trace->materialAdj[WHITE] - trace->materialAdj[BLACK];
+        score = score * material_entry->scale[score > 0 ? WHITE : BLACK] / 2;
+        score = board->side == WHITE ? score : -score;
+        if (score < lazy_alpha || score > lazy_beta) {
+            *estimated = 1;
+            return score;
         }
     }
+    Bitboard open_files = pawn_entry->semi_open[WHITE] & pawn_entry->semi_open[BLACK];
 
-    int pawns = wPawns + bPawns;
-    int white_bishops = count_bits(board->bitboards[B]);
-    int black_bishops = count_bits(board->bitboards[b]);
-    int white_knights = count_bits(board->bitboards[N]);
-    int black_knights = count_bits(board->bitboards[n]);
-    
-    // Bishop pair
-    if (white_bishops > 1) Score.positionMetrics[WHITE] += BISHOP_PAIR_BONUS;
-    if (black_bishops > 1) Score.positionMetrics[BLACK] += BISHOP_PAIR_BONUS;
+    // Every piece's attacks are looked up once here, for mobility, king safety and threats
+    AttackMap attacks;
+    build_attack_map(board, &attacks);
+    trace->mobility[WHITE] = attacks.mobility[WHITE];
+    trace->mobility[BLACK] = attacks.mobility[BLACK];
+
+    // If there is a pawn on c2 and a knight on c3, the knight gets a penalty of 5 
+    if (GET_BIT(board->bitboards[N], c3) && (board->bitboards[P] & c2) && (board->bitboards[P] & d4) && !(board->bitboards[P] & e4)) {
+        trace->positionMetrics[WHITE] += KNIGHT_BLOCK_C3_PENALTY;
+    }
+    if (GET_BIT(board->bitboards[n], c6) && (board->bitboards[p] & c7) && (board->bitboards[p] & d5) && !(board->bitboards[p] & e5)) {
+        trace->positionMetrics[BLACK] += KNIGHT_BLOCK_C3_PENALTY;
+    }
+
+    // Prevent the queen from developing too early
+    Bitboard bitboard = board->bitboards[Q];
+    while (bitboard) {
+        int square = get_least_sig_bit_index(bitboard);
+        if (rank_masks[square] > 2) {
+            if (board->bitboards[N] & b1) trace->positionMetrics[WHITE] += QUEEN_DEVELOPMENT_PENALTY; 
+            if (board->bitboards[N] & g1) trace->positionMetrics[WHITE] += QUEEN_DEVELOPMENT_PENALTY; 
+            if (board->bitboards[B] & c1) trace->positionMetrics[WHITE] += QUEEN_DEVELOPMENT_PENALTY; 
+            if (board->bitboards[B] & f1) trace->positionMetrics[WHITE] += QUEEN_DEVELOPMENT_PENALTY;
+        }
+        POP_BIT(bitboard, square);
+    }
+    bitboard = board->bitboards[q];
+    while (bitboard) {
+        int square = get_least_sig_bit_index(bitboard);
+        if (rank_masks[square] < 7) {
+            if (board->bitboards[N] & b8) trace->positionMetrics[BLACK] += QUEEN_DEVELOPMENT_PENALTY; 
+            if (board->bitboards[N] & g8) trace->positionMetrics[BLACK] += QUEEN_DEVELOPMENT_PENALTY; 
+            if (board->bitboards[B] & c8) trace->positionMetrics[BLACK] += QUEEN_DEVELOPMENT_PENALTY; 
+            if (board->bitboards[B] & f8) trace->positionMetrics[BLACK] += QUEEN_DEVELOPMENT_PENALTY;
+        }
+        POP_BIT(bitboard, square);
+    }
+
+    for (int side = WHITE; side <= BLACK; side++) {
+        int offset = side == WHITE ? 0 : 6;
+
+        // Bonus for rooks on open and half-open files
+        Bitboard rooks = board->bitboards[R + offset];
+        if (rooks & pawn_entry->semi_open[side]) {
+            trace->positionMetrics[side] += count_bits(rooks & pawn_entry->semi_open[side]) * HALF_OPEN_FILE_SCORE;
+            if (rooks & open_files) {
+                trace->positionMetrics[side] += count_bits(rooks & open_files) * OPEN_FILE_SCORE;
+            }
+        }
+
+        // Penalty for kings on exposed files
+        Bitboard king = board->bitboards[K + offset];
+        if (king & pawn_entry->semi_open[side]) {
+            trace->kingSafety[side] -= HALF_OPEN_FILE_SCORE;
+        }
+        if (king & open_files) {
+            trace->kingSafety[side] -= OPEN_FILE_SCORE;
+        }
+
+        // Pieces in front of king protecting it
+        trace->kingSafety[side] += count_bits(attacks.by_piece[side][KING] & board->occupancies[side]) * KING_SAFETY_BONUS;
+
+        // Pressure on the squares around the king from the opponent's pieces, weighted by the attacker
+        int opponent = side ^ 1;
+        Bitboard king_zone = attacks.by_piece[side][KING];
+        Bitboard *attackers = attacks.by_piece[opponent];
+        if (king_zone & (attackers[KNIGHT] | attackers[BISHOP] | attackers[ROOK] | attackers[QUEEN])) {
+            trace->kingSafety[side] -= count_bits(king_zone & (attackers[KNIGHT] | attackers[BISHOP])) * MINOR_KING_ZONE_ATTACK
+                + count_bits(king_zone & attackers[ROOK]) * ROOK_KING_ZONE_ATTACK
+                + count_bits(king_zone & attackers[QUEEN]) * QUEEN_KING_ZONE_ATTACK;
+        }
+
+        // Pieces attacked by the opponent that nothing defends. Pawns and the king are left out.
+        Bitboard pieces = board->occupancies[side] & ~board->bitboards[P + offset] & ~board->bitboards[K + offset];
+        Bitboard hanging = pieces & attacks.all[opponent] & ~attacks.all[side];
+        if (hanging) {
+            trace->threats[side] += count_bits(hanging) * HANGING_PIECE_PENALTY;
+        }
+    }
 
-    // Knight pair
-    if (white_knights > 1) Score.positionMetrics[WHITE] += pawns > 10 ? KNIGHT_PAIR_BONUS : KNIGHT_PAIR_PENALTY;
-    if (black_knights > 1) Score.positionMetrics[BLACK] += pawns > 10 ? KNIGHT_PAIR_BONUS : KNIGHT_PAIR_PENALTY;
-    
     // If there are pawns on both sides of the board, bishops are better than knights in the endgame
-    if (Score.phase <= 16) { // Only take effect starting in the middlegame
+    if (trace->phase <= 16) { // Only take effect starting in the middlegame
         int pawns_on_abc_files = (board->bitboards[P] & FILE_ABC_MASK) || (board->bitboards[p] & FILE_ABC_MASK);
         int pawns_on_fgh_files = (board->bitboards[P] & FILE_FGH_MASK) || (board->bitboards[p] & FILE_FGH_MASK);
 
         if (pawns_on_abc_files && pawns_on_fgh_files) {
-            if (white_bishops > 0) {
-                Score.positionMetrics[WHITE] += BISHOP_ENDGAME_BONUS;
+            if (board->bitboards[B]) {
+                trace->positionMetrics[WHITE] += BISHOP_ENDGAME_BONUS;
             }
-            if (black_bishops > 0) {
-                Score.positionMetrics[BLACK] += BISHOP_ENDGAME_BONUS;
+            if (board->bitboards[b]) {
+                trace->positionMetrics[BLACK] += BISHOP_ENDGAME_BONUS;
             }
         }
     }
 
     // Mobility adjustments are made in such a way that a score of 0 is roughly "average" mobility for each piece in the given game phase. 
-    Score.openingMobility[WHITE] += 4 * (wKnightMob - KIGHT_MOB_ADJ);
-    Score.endgameMobility[WHITE] += 4 * (wKnightMob - KIGHT_MOB_ADJ);
-    Score.openingMobility[WHITE] += 3 * (wBishopMob - BISHOP_MOB_ADJ);
-    Score.endgameMobility[WHITE] += 3 * (wBishopMob - BISHOP_MOB_ADJ);
-    Score.openingMobility[WHITE] += 2 * (wRookMob   - ROOK_MOB_ADJ); 
-    Score.endgameMobility[WHITE] += 4 * (wRookMob   - ROOK_MOB_ADJ); 
-    Score.openingMobility[WHITE] += 1 * (wQueenMob  - QUEEN_MOB_ADJ);
-    Score.endgameMobility[WHITE] += 2 * (wQueenMob  - QUEEN_MOB_ADJ);
-    Score.endgameMobility[WHITE] += 1 * (wKingMob   - KING_MOB_ADJ);
-    Score.openingMobility[BLACK] += 4 * (bKnightMob - KIGHT_MOB_ADJ);
-    Score.endgameMobility[BLACK] += 4 * (bKnightMob - KIGHT_MOB_ADJ);
-    Score.openingMobility[BLACK] += 3 * (bBishopMob - BISHOP_MOB_ADJ);
-    Score.endgameMobility[BLACK] += 3 * (bBishopMob - BISHOP_MOB_ADJ);
-    Score.openingMobility[BLACK] += 2 * (bRookMob   - ROOK_MOB_ADJ); 
-    Score.endgameMobility[BLACK] += 4 * (bRookMob   - ROOK_MOB_ADJ); 
-    Score.openingMobility[BLACK] += 1 * (bQueenMob  - QUEEN_MOB_ADJ);
-    Score.endgameMobility[BLACK] += 2 * (bQueenMob  - QUEEN_MOB_ADJ);
-    Score.endgameMobility[BLACK] += 1 * (bKingMob   - KING_MOB_ADJ);
+    PackedScore average_mobility = KNIGHT_MOBILITY * KIGHT_MOB_ADJ + BISHOP_MOBILITY * BISHOP_MOB_ADJ + ROOK_MOBILITY * ROOK_MOB_ADJ
+        + QUEEN_MOBILITY * QUEEN_MOB_ADJ + KING_MOBILITY * KING_MOB_ADJ;
+    trace->mobility[WHITE] -= average_mobility;
+    trace->mobility[BLACK] -= average_mobility;
         
     /* 
         Tapered Evaluation
@@ -672,11 +827,11 @@ int evaluate(Board *board) {
         However, in the middle game, neither position may be 100% right. As the middle game advances, the scores slowly shift towards the endgame,
         this allows the engine to make more precise decisions.
     */
-    if (Score.phase > 24) {
-        Score.phase = 24;
+    if (trace->phase > 24) {
+        trace->phase = 24;
     }
 
-    int middle_game_weight = Score.phase;
+    int middle_game_weight = trace->phase;
     int endgame_weight = 24 - middle_game_weight;
 
     // Final score calculation
@@ -684,23 +839,11 @@ int evaluate(Board *board) {
  
     // Add material, mobility, and PST scores. Interpolate for the middle game.
     // King safety is included in the opening score, but as the game progresses, this metric is reduced until it doesn't matter in the endgame.
-    int opening_score = 
-        (Score.material[WHITE] 
-            + Score.openingPST[WHITE] 
-            + Score.openingMobility[WHITE] 
-            + Score.kingSafety[WHITE]) 
-        - (Score.material[BLACK] 
-            + Score.openingPST[BLACK] 
-            + Score.openingMobility[BLACK] 
-            + Score.kingSafety[BLACK]);
-
-    int endgame_score = 
-        (Score.material[WHITE] 
-            + Score.endgamePST[WHITE] 
-            + Score.endgameMobility[WHITE]) 
-        - (Score.material[BLACK] 
-            + Score.endgamePST[BLACK] 
-            + Score.endgameMobility[BLACK]);
+    PackedScore total = trace->psq[WHITE] - trace->psq[BLACK]
+        + trace->mobility[WHITE] - trace->mobility[BLACK]
+        + PACK_SCORE(trace->kingSafety[WHITE] - trace->kingSafety[BLACK], 0);
+    int opening_score = opening_value(total);
+    int endgame_score = endgame_value(total);
 
     score += ((opening_score * middle_game_weight) + (endgame_score * endgame_weight)) / 24;
     
@@ -708,52 +851,14 @@ int evaluate(Board *board) {
         Game phase independent scores. These scores keep track of more complex positional evaluations such as pawn structure or positional metrics.
         These values do not need to be interpolated as they are not dependent on the game phase.
     */
-    score += (Score.pawnStructure[WHITE] - Score.pawnStructure[BLACK]);
-    score += (Score.positionMetrics[WHITE] - Score.positionMetrics[BLACK]);
-    score += (Score.materialAdj[WHITE] - Score.materialAdj[BLACK]);
-
-    /*                                                                  
-        Account of low material situations. Without this, the engine will think it is leading when it has insufficient material.
-
-        - 1 Minor cannot win                               
-        - 2 knights cannot win                      
-        - Rook vs Minor is drawish                           
-        - Rook + Minor vs Rook is drawish                        
-    */
-   int leading, trailing = 0;
-    if (score > 0) {
-        leading = WHITE;
-        trailing = BLACK;
-    } else {
-        leading = BLACK;
-        trailing = WHITE;
-    }
-
-    int leadingPawns = (leading == WHITE) ? wPawns : bPawns; 
-    if (leadingPawns == 0) {
-
-        // Cases where it is impossible to win with no pawns
-        if (Score.material[leading] < 400) {
-            return 0;
-        }
-        if (bPawns == 0 && Score.material[trailing] == 2 * MATERIAL_SCORE[N]) {
-            return 0;
-        }
-
-        // Cases where it is possible, but very unlikely to win with no pawns
-        if (Score.material[leading] == MATERIAL_SCORE[ROOK] && Score.material[trailing] == MATERIAL_SCORE[BISHOP]) {
-            score /= 2;
-        }
-        if (Score.material[leading] == MATERIAL_SCORE[ROOK] && Score.material[trailing] == MATERIAL_SCORE[KNIGHT]) {
-            score /= 2;
-        }
-        if (Score.material[leading] == MATERIAL_SCORE[ROOK] + MATERIAL_SCORE[BISHOP] && Score.material[trailing] == MATERIAL_SCORE[ROOK]) {
-            score /= 2;
-        }
-        if (Score.material[leading] == MATERIAL_SCORE[ROOK] + MATERIAL_SCORE[KNIGHT] && Score.material[trailing] == MATERIAL_SCORE[ROOK]) {
-            score /= 2;
-        }
-    }
+    score += (trace->pawnStructure[WHITE] - trace->pawnStructure[BLACK]);
+    score += (trace->positionMetrics[WHITE] - trace->positionMetrics[BLACK]);
+    score += (trace->threats[WHITE] - trace->threats[BLACK]);
+    score += (trace->materialAdj[WHITE] - trace->materialAdj[BLACK]);
+
+    // Scale the score down when the side ahead does not have the material to win
+    int leading = score > 0 ? WHITE : BLACK;
+    score = score * material_entry->scale[leading] / 2;
     return (board->side == WHITE) ? score : -score;
 }
 
@@ -765,18 +870,20 @@ void printEvalFactor(int wh, int bl) {
  * Prints all evaluation metrics for debugging purposes.
  */
 void printEval(Board *board) {
+  EvalTrace trace[1];
   printf("------------------------------------------\n");
-  printf("Total value (for side to move): %d \n", evaluate(board));
-  printf("Material balance:     %d \n", Score.material[WHITE] - Score.material[BLACK]);
-  printf("Material:             "); printEvalFactor(Score.material[WHITE], Score.material[BLACK]);
-  printf("Material adj:         "); printEvalFactor(Score.materialAdj[WHITE], Score.materialAdj[BLACK]);
-  printf("Op PST:               "); printEvalFactor(Score.openingPST[WHITE], Score.openingPST[BLACK]);
-  printf("Eg PST:               "); printEvalFactor(Score.endgamePST[WHITE], Score.endgamePST[BLACK]);
-  printf("Op Mobility:          "); printEvalFactor(Score.openingMobility[WHITE], Score.openingMobility[BLACK]);
-  printf("eg Mobility:          "); printEvalFactor(Score.endgameMobility[WHITE], Score.endgameMobility[BLACK]);
-  printf("Pawn structure:       "); printEvalFactor(Score.pawnStructure[WHITE], Score.pawnStructure[BLACK]);
-  printf("Positional Metrics:   "); printEvalFactor(Score.positionMetrics[WHITE], Score.positionMetrics[BLACK]);
-  printf("King Safety:          "); printEvalFactor(Score.kingSafety[WHITE], Score.kingSafety[BLACK]);
+  printf("Total value (for side to move): %d \n", trace_evaluation(board, trace));
+  printf("Material balance:     %d \n", trace->material[WHITE] - trace->material[BLACK]);
+  printf("Material:             "); printEvalFactor(trace->material[WHITE], trace->material[BLACK]);
+  printf("Material adj:         "); printEvalFactor(trace->materialAdj[WHITE], trace->materialAdj[BLACK]);
+  printf("Op PST:               "); printEvalFactor(opening_value(trace->psq[WHITE]) - trace->material[WHITE], opening_value(trace->psq[BLACK]) - trace->material[BLACK]);
+  printf("Eg PST:               "); printEvalFactor(endgame_value(trace->psq[WHITE]) - trace->material[WHITE], endgame_value(trace->psq[BLACK]) - trace->material[BLACK]);
+  printf("Op Mobility:          "); printEvalFactor(opening_value(trace->mobility[WHITE]), opening_value(trace->mobility[BLACK]));
+  printf("eg Mobility:          "); printEvalFactor(endgame_value(trace->mobility[WHITE]), endgame_value(trace->mobility[BLACK]));
+  printf("Pawn structure:       "); printEvalFactor(trace->pawnStructure[WHITE], trace->pawnStructure[BLACK]);
+  printf("Positional Metrics:   "); printEvalFactor(trace->positionMetrics[WHITE], trace->positionMetrics[BLACK]);
+  printf("King Safety:          "); printEvalFactor(trace->kingSafety[WHITE], trace->kingSafety[BLACK]);
+  printf("Threats:              "); printEvalFactor(trace->threats[WHITE], trace->threats[BLACK]);
   printf("\n");
   printf("------------------------------------------\n");
 }
\ No newline at end of file
@@ -2,15 +2,104 @@
 #define EVAL_H
 
 #include "bitboard.h"
+#include "table.h"
+
+/*
+ Packed scores hold the endgame value in the upper 16 bits and the opening value in the lower 16 bits.
+ Adding, subtracting or multiplying packed scores by an integer works on both values at once,
+ so each evaluation term costs a single operation. The values are only unpacked for the tapered interpolation.
+*/
+#define PACK_SCORE(opening, endgame) ((PackedScore)((unsigned int)(endgame) << 16) + (opening))
+
+static inline int opening_value(PackedScore score) {
+    return (int16_t)(uint16_t)(unsigned int)score;
+}
+
+// Rounds the upper half up when the lower half is negative, undoing its borrow
+static inline int endgame_value(PackedScore score) {
+    return (int16_t)(uint16_t)((unsigned int)(score + 0x8000) >> 16);
+}
+
+/**
+ * Squares attacked by each side, by piece type and in total, built once per evaluation by build_attack_map().
+ * Each piece's attacks are looked up once and shared by mobility, king safety and threats.
+ * Pawn attacks are found for all the pawns of a side at once by shifting them.
+ */
+typedef struct {
+    Bitboard by_piece[2][6]; // Indexed by [side][PAWN, KNIGHT, BISHOP, ROOK, QUEEN, KING]
+    Bitboard all[2];
+    PackedScore mobility[2]; // Summed per piece while its attacks are added
+} AttackMap;
+
+/**
+ * The terms of a classical evaluation for each side, filled in for the caller by the evaluation.
+ * The evaluation keeps no state of its own between calls, so boards can be evaluated from any number of threads.
+ */
+typedef struct {
+    int phase;
+    int material[2];
+    PackedScore psq[2];
+    PackedScore mobility[2];
+    int pawnStructure[2];
+    int materialAdj[2];
+    int kingSafety[2];
+    int threats[2];
+    int positionMetrics[2];
+} EvalTrace;
 
 int evaluate(Board*);
+int evaluate_lazy(Board*, int, int);
+int trace_evaluation(Board*, EvalTrace*);
 void init_evaluation_masks();
 void printEval(Board*);
-int get_material(int);
+int get_material(Board*, int);
+void compute_piece_scores(Board*, PieceScores*);
+void evaluate_pawns(Board*, PawnEntry*);
+void build_attack_map(Board*, AttackMap*);
 
 // Material scores indexed by the piece type [PAWN, KNIGHT, BISHIOP, ROOK, QUEEN, KING]
 static const int MATERIAL_SCORE[6] = { 100, 325, 335, 500, 975, 0 };
 
+// Pawn structure scores
+static const int DOUBLE_PAWN_PENALTY = -20;
+static const int ISOLATED_PAWN_PENALTY = -15;
+
+// Passed pawn scores indexed by the rank.
+static const int PASSED_PAWN_BONUS[8] = { 0, 10, 20, 40, 60, 80, 100, 200 }; 
+
+// Packed piece-square values with the material included, indexed by [piece][square] with the black tables mirrored.
+// Built by init_evaluation_masks().
+extern PackedScore piece_square[12][64];
+extern const int PIECE_PHASE[12];
+
+/*
+ Incremental updates of the board's PieceScores, called by make_move() for every piece it places or removes.
+ unmake_move() restores the scores saved before the move instead.
+*/
+static inline void add_piece_score(PieceScores *scores, int piece, int square) {
+    int side = piece >= 6;
+    scores->material[side] += MATERIAL_SCORE[piece % 6];
+    scores->psq[side] += piece_square[piece][square];
+    scores->phase += PIECE_PHASE[piece];
+}
+
+static inline void remove_piece_score(PieceScores *scores, int piece, int square) {
+    int side = piece >= 6;
+    scores->material[side] -= MATERIAL_SCORE[piece % 6];
+    scores->psq[side] -= piece_square[piece][square];
+    scores->phase -= PIECE_PHASE[piece];
+}
+
+static inline void move_piece_score(PieceScores *scores, int piece, int src, int target) {
+    int side = piece >= 6;
+    scores->psq[side] += piece_square[piece][target] - piece_square[piece][src];
+}
+
+// How far the cheap terms of the evaluation must be outside the window for evaluate_lazy() to return them
+#define LAZY_EVAL_MARGIN 200
+
+extern _Thread_local unsigned long long lazy_evals, lazy_exits;
+
 // The threshold of material where the endgame phase begins
 static const int ENDGAME_MATERIAL_THRESHOLD = 1300;
 
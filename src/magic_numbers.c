@@ -0,0 +1,76 @@
+// Generated by tools/find_magics.c (make magics) with seed 1804289383 and 1000000 attempts per reduced bit count.
+#include "bitboard.h"
+
+const Bitboard rook_magics[64] = {
+    0x8880004000801020ULL, 0xc0002000411000ULL, 0x100082000110040ULL,
+    0x4080041000080280ULL, 0xe00041008200200ULL, 0x200100402000801ULL,
+    0x9500008b00120004ULL, 0x2080002040800100ULL, 0x400802080004000ULL,
+    0x818880200480400bULL, 0x493001504402000ULL, 0x800b001000200902ULL,
+    0x8000800800800400ULL, 0x2000200081004ULL, 0x110802100804200ULL,
+    0x5012800080004100ULL, 0x282808000654000ULL, 0x4200404010002000ULL,
+    0x302020024104080ULL, 0x84200200a0010ULL, 0x20110008010004ULL,
+    0x8181010004000208ULL, 0x4040002104108ULL, 0x4041020000410084ULL,
+    0xb010802a8002c008ULL, 0x10004040002004ULL, 0x8001004100102000ULL,
+    0xc00100080080080ULL, 0x3002002200080410ULL, 0x201000300040008ULL,
+    0x4080080400020110ULL, 0x820408200004104ULL, 0x2400280e2800140ULL,
+    0x2450004000402005ULL, 0x8890801000802000ULL, 0x2000500103002008ULL,
+    0x1878040080800800ULL, 0x2000802001004ULL, 0x4004022104000850ULL,
+    0x8402000041ULL, 0x200400080208000ULL, 0x8000804001010021ULL,
+    0x9802420084120020ULL, 0xc120040220008ULL, 0x1000801110004ULL,
+    0x200020004008080ULL, 0x2080100108040002ULL, 0x844010040820004ULL,
+    0x800021004100ULL, 0x71002a0840810200ULL, 0x8800200080100080ULL,
+    0xa090090002300ULL, 0x4400040008008080ULL, 0x802000400028080ULL,
+    0x1040021001080400ULL, 0xa000800041003080ULL, 0x102012010814902ULL,
+    0x4002008810204102ULL, 0x2005002000081041ULL, 0x245000820041001ULL,
+    0x2109000800045003ULL, 0x70d008208440001ULL, 0x11201130902a0804ULL,
+    0x80844008110a2ULL,
+};
+
+const Bitboard bishop_magics[64] = {
+    0x30840808024014ULL, 0x18080084114508ULL, 0x1141042100420500ULL,
+    0xc1182a0020420200ULL, 0x4c2021000021000ULL, 0x8001100210522058ULL,
+    0xa208220501002ULL, 0x152010048220802ULL, 0x8449050802084201ULL,
+    0x300420208120084ULL, 0x8080040104011800ULL, 0x607082040401008ULL,
+    0x8001042c20014000ULL, 0x20802080402ULL, 0x1000020250040440ULL,
+    0x300408401019030ULL, 0x8820420080249ULL, 0x124000210044501ULL,
+    0x40200100402400cULL, 0x20400202c208028ULL, 0x1a62001400942000ULL,
+    0x202000d00820108ULL, 0x682210245100810ULL, 0x2000080940101ULL,
+    0x4002080042083800ULL, 0x40102208d0040904ULL, 0x220430048204ULL,
+    0x220080009004008ULL, 0x1008488004002002ULL, 0x200a002006101000ULL,
+    0x2000810884044200ULL, 0x1002004082310800ULL, 0x401101000082028ULL,
+    0x4028088221081208ULL, 0x80840038000401c5ULL, 0x800020080080081ULL,
+    0x10020200002008ULL, 0x2008008000406bULL, 0x810210100684400ULL,
+    0x840810444820200ULL, 0x2080208144200ULL, 0x813009a20001110ULL,
+    0x40082088001000ULL, 0x22011100800ULL, 0x100c04100c008880ULL,
+    0x41502020a1201100ULL, 0x142881204000080ULL, 0x40d408a608400200ULL,
+    0x400823050040080ULL, 0x12012401040c14ULL, 0x4200010241300001ULL,
+    0x1010000020880001ULL, 0x4040010120a1028ULL, 0x12402458008280ULL,
+    0x1090020084000cULL, 0x251010200860010ULL, 0x200402090101000ULL,
+    0x1000014904092040ULL, 0x1000900411000ULL, 0x20500090460808ULL,
+    0x8020000010202200ULL, 0x1000404888a00ULL, 0x20100208482088ULL,
+    0x11702000842a4040ULL,
+};
+
+// The number of bits in the magic index of each square, at most the number of squares in its attack mask.
+const int bishop_relevant_bits[64] = {
+    6, 5, 5, 5, 5, 5, 5, 6,
+    5, 5, 5, 5, 5, 5, 5, 5,
+    5, 5, 7, 7, 7, 7, 5, 5,
+    5, 5, 7, 9, 9, 7, 5, 5,
+    5, 5, 7, 9, 9, 7, 5, 5,
+    5, 5, 7, 7, 7, 7, 5, 5,
+    5, 5, 5, 5, 5, 5, 5, 5,
+    6, 5, 5, 5, 5, 5, 5, 6,
+};
+
+const int rook_relevant_bits[64] = {
+    12, 11, 11, 11, 11, 11, 11, 12,
+    11, 10, 10, 10, 10, 10, 10, 11,
+    11, 10, 10, 10, 10, 10, 10, 11,
+    11, 10, 10, 10, 10, 10, 10, 11,
+    11, 10, 10, 10, 10, 10, 10, 11,
+    11, 10, 10, 10, 10, 10, 10, 11,
+    11, 10, 10, 10, 10, 10, 10, 11,
+    12, 11, 11, 11, 11, 11, 11, 12,
+};
+
@@ -0,0 +1,9 @@
+// Generated by tools/find_magics.c (make magics) with seed 1804289383 and 1000000 attempts per reduced bit count.
+#ifndef MAGIC_NUMBERS_H
+#define MAGIC_NUMBERS_H
+
+// Total entries of each magic slider table: the sum over all squares of 2^(relevant bits)
+#define BISHOP_MAGIC_TABLE_SIZE 5248
+#define ROOK_MAGIC_TABLE_SIZE 102400
+
+#endif
@@ -4,7 +4,7 @@
 #include "magics.h"
 /** 
 * This approach attempts to find magic numbers by trying random numbers with a low number of non-zero bits by brute force.
-* This code is not run with the engine, but was used to generate the magic numbers seen in [bitboard.c].
+* find_magic() is not run with the engine. tools/find_magics.c (make magics) uses it to generate [magic_numbers.c].
 
 *************************************************************************
 * Credit to Tord Romstad for this approach 
@@ -14,8 +14,9 @@
 
 unsigned int state = 1804289383; // random starting number
 
-unsigned int generate_random_U32_number() {
-    unsigned int num = state;
+// Each caller owns its state, so magic searches on several threads do not share one sequence
+unsigned int random_U32(unsigned int *state) {
+    unsigned int num = *state;
 
     // XOR shift 32 algorithm
     num ^= num << 13;
@@ -23,56 +24,71 @@ unsigned int generate_random_U32_number() {
     num ^= num << 5;
 
     // update state
-    state = num;
+    *state = num;
     return num;
 }
 
- Bitboard generate_random_U64_number() {
+Bitboard random_U64(unsigned int *state) {
 
     // Random numbers
     Bitboard n1, n2, n3, n4;
     
     // init random numbers slicing 16 bits from MS1B side
-    n1 = (Bitboard)(generate_random_U32_number() & 0xFFFF);
-    n2 = (Bitboard)(generate_random_U32_number() & 0xFFFF);
-    n3 = (Bitboard)(generate_random_U32_number() & 0xFFFF);
-    n4 = (Bitboard)(generate_random_U32_number() & 0xFFFF);
+    n1 = (Bitboard)(random_U32(state) & 0xFFFF);
+    n2 = (Bitboard)(random_U32(state) & 0xFFFF);
+    n3 = (Bitboard)(random_U32(state) & 0xFFFF);
+    n4 = (Bitboard)(random_U32(state) & 0xFFFF);
     
     // Shuffle
     return n1 | (n2 << 16) | (n3 << 32) | (n4 << 48);
- }
+}
+
+unsigned int generate_random_U32_number() {
+    return random_U32(&state);
+}
+
+Bitboard generate_random_U64_number() {
+    return random_U64(&state);
+}
 
- Bitboard generate_magic_bitboard() {
-    return generate_random_U64_number() & generate_random_U64_number() & generate_random_U64_number();
- }
+// Magic candidates with few set bits are far more likely to work
+static Bitboard random_magic(unsigned int *state) {
+    return random_U64(state) & random_U64(state) & random_U64(state);
+}
 
-Bitboard _find_magic_bitboard(int square, int relevant_bits, int is_bishop) {
+/**
+ * Tries up to attempts random candidates for a magic that maps every occupancy of the square's mask to an index of relevant_bits bits.
+ * Occupancies may share an index only if they produce the same attacks, so relevant_bits can be below the bits in the mask.
+ * Returns 0 if no magic was found.
+ */
+Bitboard find_magic(int square, int relevant_bits, int is_bishop, unsigned int *state, long attempts) {
     Bitboard occupancies[4096];
     Bitboard attacks_table[4096];
     Bitboard used_attacks[4096]; 
 
     Bitboard attack_mask = is_bishop ? mask_bishop_attacks(square) : mask_rook_attacks(square);
+    int mask_bits = count_bits(attack_mask);
 
-    int occupancy_indicies = 1 << relevant_bits;
+    int occupancy_indicies = 1 << mask_bits;
 
     for (int i = 0; i < occupancy_indicies; i++) {
-        occupancies[i] = set_occupancy(i, relevant_bits, attack_mask);
+        occupancies[i] = set_occupancy(i, mask_bits, attack_mask);
         attacks_table[i] = is_bishop ? generate_bishop_attacks(square, occupancies[i]) : generate_rook_attacks(square, occupancies[i]);
     }
 
     // test generated magic bitboard
-    for (int i = 0; i < 100000000; i++) {
+    for (long i = 0; i < attempts; i++) {
 
         // Random magic bitboard candidate
-        Bitboard magic_bitboard = generate_magic_bitboard();
+        Bitboard magic_bitboard = random_magic(state);
 
         // Skip known bad magic numbers
         if (count_bits((attack_mask * magic_bitboard) & 0xFF00000000000000) < 6) {
             continue;
         }
 
-        // Save to used attacks
-        memset(used_attacks, 0ULL, sizeof(used_attacks));
+        // Save to used attacks. Slider attacks are never empty, so 0 marks an unused index.
+        memset(used_attacks, 0ULL, sizeof(Bitboard) << relevant_bits);
         
         int index, fail;
 
@@ -95,25 +111,6 @@ Bitboard _find_magic_bitboard(int square, int relevant_bits, int is_bishop) {
 
         return magic_bitboard;
     }
-        // Magic bitboard doesn't work
-        printf("Magic bitboard failed");
-        return 0ULL;
+    // Magic bitboard doesn't work
+    return 0ULL;
 }
-
-Bitboard _rook_magics[64];
-Bitboard _bishop_magics[64];
-
-
-void _init_magic_bitboards() {
-    // Loops over board and check magic bitboard for each square
-    // Rook
-    for (int square = 0; square < 64; square++) {
-        _rook_magics[square] = _find_magic_bitboard(square, rook_relevant_bits[square], sROOK);
-    }
-
-    // Bishop
-    for (int square = 0; square < 64; square++) {
-        // Bishop
-        _bishop_magics[square] = _find_magic_bitboard(square, bishop_relevant_bits[square], sBISHOP);
-    }
-}
\ No newline at end of file
@@ -3,7 +3,10 @@
 
 #include "bitboard.h"
 
+unsigned int random_U32(unsigned int*);
+Bitboard random_U64(unsigned int*);
 unsigned int generate_random_U32_number();
 Bitboard generate_random_U64_number();
+Bitboard find_magic(int, int, int, unsigned int*, long);
 
-#endif
\ No newline at end of file
+#endif
@@ -3,6 +3,8 @@
 #include "move.h"
 #include "table.h"
 #include "board.h"
+#include "eval.h"
+#include "nnue.h"
 
 /*
 Used to determine whether castling rights have changed.
@@ -29,18 +31,130 @@ const int castling_rights[64] = {
     13, 15, 15, 15, 12, 15, 15, 14
 };
 
-void generate_moves(Moves *moves, Board *board) {
+// Promotion rank of each side. Pawn moves to these squares are generated with the captures.
+static const Bitboard promotion_ranks[2] = {
+    [WHITE] = 0xffULL,
+    [BLACK] = 0xff00000000000000ULL,
+};
+
+// Pieces of the given side giving check to the king on king_square.
+static inline Bitboard get_checkers(int king_square, int side, Board *board) {
+    int offset = (side == WHITE) ? 6 : 0;
+    Bitboard occupancy = board->occupancies[BOTH];
+    Bitboard diagonal = board->bitboards[B + offset] | board->bitboards[Q + offset];
+    Bitboard straight = board->bitboards[R + offset] | board->bitboards[Q + offset];
+
+    return (pawn_attacks[side][king_square] & board->bitboards[P + offset])
+        | (knight_attacks[king_square] & board->bitboards[N + offset])
+        | (get_bishop_attacks(king_square, occupancy) & diagonal)
+        | (get_rook_attacks(king_square, occupancy) & straight);
+}
+
+// Pieces of the given side that are the only piece between their king and an opponent slider.
+static inline Bitboard get_pinned(int king_square, int side, Board *board) {
+    int offset = (side == WHITE) ? 6 : 0;
+    Bitboard pinned = 0ULL;
+    Bitboard snipers = (get_bishop_attacks(king_square, 0ULL) & (board->bitboards[B + offset] | board->bitboards[Q + offset]))
+        | (get_rook_attacks(king_square, 0ULL) & (board->bitboards[R + offset] | board->bitboards[Q + offset]));
+
+    while (snipers) {
+        int sniper = get_least_sig_bit_index(snipers);
+        Bitboard blockers = between_squares[king_square][sniper] & board->occupancies[BOTH];
+        if (blockers && !(blockers & (blockers - 1)) && (blockers & board->occupancies[side])) {
+            pinned |= blockers;
+        }
+        POP_BIT(snipers, sniper);
+    }
+    return pinned;
+}
+
+// A pinned piece may only move along the line through its king and the pinning piece.
+static inline Bitboard pin_mask(int src, MoveTargets *move_targets) {
+    return GET_BIT(move_targets->pinned, src) ? line_squares[move_targets->king_square][src] : ~0ULL;
+}
+
+/**
+ * Every generator shares the per-piece generators. The type selects which target squares moves may land on:
+ *  ALL_MOVES: any square not occupied by the side to move.
+ *  CAPTURES:  squares occupied by the opponent, plus promotions and en passant.
+ *  QUIETS:    empty squares, excluding promotions and en passant. Castling is only generated here.
+ *
+ * Only legal moves are generated. Checkers and pinned pieces are found once, then:
+ *  - In double check only the king can move.
+ *  - In check every other piece must capture the checker or block between it and the king.
+ *  - Pinned pieces only move along their pin line.
+ *  - King moves and en passant captures are tested individually.
+ */
+static void generate(int type, Moves *moves, Board *board) {
+    int side = board->side;
+    Bitboard targets, pawn_targets;
+    Bitboard enpassant = (board->enpassant != na) ? 1ULL << board->enpassant : 0ULL;
+
+    switch (type) {
+        case CAPTURES:
+            targets = board->occupancies[side ^ 1];
+            pawn_targets = targets | promotion_ranks[side];
+            break;
+        case QUIETS:
+            targets = ~board->occupancies[BOTH];
+            pawn_targets = targets & ~promotion_ranks[side] & ~enpassant;
+            enpassant = 0ULL;
+            break;
+        default:
+            targets = ~board->occupancies[side];
+            pawn_targets = targets;
+            break;
+    }
+
+    MoveTargets move_targets[1];
+    move_targets->king_square = get_least_sig_bit_index(board->bitboards[(side == WHITE) ? K : k]);
+    move_targets->king_targets = targets;
+    move_targets->pinned = get_pinned(move_targets->king_square, side, board);
+
     moves->count = 0;
-    generate_pawn_moves(board->side, moves, board);
-    generate_knight_moves(board->side, moves, board);
-    generate_bishop_moves(board->side, moves, board);
-    generate_rook_moves(board->side, moves, board);
-    generate_queen_moves(board->side, moves, board);
-    generate_king_moves(board->side, moves, board);
-    generate_castling_moves(board->side, moves, board);
+    Bitboard checkers = get_checkers(move_targets->king_square, side, board);
+
+    if (checkers & (checkers - 1)) {
+        generate_king_moves(side, move_targets, moves, board);
+        return;
+    }
+
+    if (checkers) {
+        Bitboard evasions = between_squares[move_targets->king_square][get_least_sig_bit_index(checkers)] | checkers;
+        targets &= evasions;
+        pawn_targets &= evasions;
+    }
+
+    // En passant captures are checked for legality when they are generated
+    move_targets->targets = targets;
+    move_targets->pawn_targets = pawn_targets | enpassant;
+
+    generate_pawn_moves(side, move_targets, moves, board);
+    generate_knight_moves(side, move_targets, moves, board);
+    generate_bishop_moves(side, move_targets, moves, board);
+    generate_rook_moves(side, move_targets, moves, board);
+    generate_queen_moves(side, move_targets, moves, board);
+    generate_king_moves(side, move_targets, moves, board);
+    if (type != CAPTURES && !checkers) {
+        generate_castling_moves(side, moves, board);
+    }
+}
+
+void generate_moves(Moves *moves, Board *board) {
+    generate(ALL_MOVES, moves, board);
 }
 
-void generate_pawn_moves(int side, Moves *moves, Board *board) {
+// Captures, en passant and promotions (including non-capture promotions).
+void generate_captures(Moves *moves, Board *board) {
+    generate(CAPTURES, moves, board);
+}
+
+// Non-capture moves that are not promotions, including castling.
+void generate_quiets(Moves *moves, Board *board) {
+    generate(QUIETS, moves, board);
+}
+
+void generate_pawn_moves(int side, MoveTargets *move_targets, Moves *moves, Board *board) {
     int src, target, direction, opponent;
     int piece = (side == WHITE) ? P : p;
     Bitboard bitboard = board->bitboards[piece];
@@ -64,42 +178,47 @@ void generate_pawn_moves(int side, Moves *moves, Board *board) {
     while (bitboard) {
         src = get_least_sig_bit_index(bitboard);
         target = src + direction; // pawn moves forward
+        Bitboard targets = move_targets->pawn_targets & pin_mask(src, move_targets);
 
         if ((side == WHITE && target >= a8) || (side == BLACK && target <= h1)) {
             if (!GET_BIT(board->occupancies[BOTH], target)) {
                 // Promotion
                 if (src >= promotion_rank_start && src <= promotion_rank_end) {
-                    for (int i = 0; i < 4; ++i) {
-                        int move = encode_move(src, target, piece, pieces[i], 0, 0, 0, 0);
-                        add_move(moves, move);
+                    if (GET_BIT(targets, target)) {
+                        for (int i = 0; i < 4; ++i) {
+                            int move = encode_move(src, target, piece, pieces[i], 0, 0, 0, 0, 0);
+                            add_move(moves, move);
+                        }
                     }
                 } else {
                     // One square
-                    int move = encode_move(src, target, piece, 0, 0, 0, 0, 0);
-                    add_move(moves, move);
+                    if (GET_BIT(targets, target)) {
+                        int move = encode_move(src, target, piece, 0, 0, 0, 0, 0, 0);
+                        add_move(moves, move);
+                    }
 
-                    // Pawn jump
-                    if (src >= double_move_rank_start && src <= double_move_rank_end && !GET_BIT(board->occupancies[BOTH], target + direction)) {
-                        move = encode_move(src, target + direction, piece, 0, 0, 1, 0, 0);
+                    // Pawn jump. The single push square may not block a check while the jump does.
+                    if (src >= double_move_rank_start && src <= double_move_rank_end && !GET_BIT(board->occupancies[BOTH], target + direction) && GET_BIT(targets, target + direction)) {
+                        int move = encode_move(src, target + direction, piece, 0, 0, 0, 1, 0, 0);
                         add_move(moves, move);
                     }
                 }
             }
         }
 
-        Bitboard attacks = board->pawn_attacks[side][src] & board->occupancies[opponent];
+        Bitboard attacks = pawn_attacks[side][src] & board->occupancies[opponent] & targets;
         while (attacks) {
             target = get_least_sig_bit_index(attacks);
 
             // Promotion capture
             if (src >= promotion_rank_start && src <= promotion_rank_end) {
                 for (int i = 0; i < 4; ++i) {
-                    int move = encode_move(src, target, piece, pieces[i], 1, 0, 0, 0);
+                    int move = encode_move(src, target, piece, pieces[i], 1, board->mailbox[target], 0, 0, 0);
                     add_move(moves, move);
                 }
             } else {
                 // Regular capture
-                int move = encode_move(src, target, piece, 0, 1, 0, 0, 0);
+                int move = encode_move(src, target, piece, 0, 1, board->mailbox[target], 0, 0, 0);
                 add_move(moves, move);
             }
 
@@ -107,15 +226,18 @@ void generate_pawn_moves(int side, Moves *moves, Board *board) {
         }
 
         // En Passant
-        if (board->enpassant != na) {
+        if (board->enpassant != na && GET_BIT(targets, board->enpassant)) {
             int enpassant_file = board->enpassant % 8;
             if (src >= enpassant_rank && src <= enpassant_rank + 7 &&
                 (src % 8 == enpassant_file - 1 || src % 8 == enpassant_file + 1)) {
-                Bitboard enpassant_attacks = board->pawn_attacks[side][src] & (1ULL << board->enpassant);
+                Bitboard enpassant_attacks = pawn_attacks[side][src] & (1ULL << board->enpassant);
                 if (enpassant_attacks) {
                     int ep_target = get_least_sig_bit_index(enpassant_attacks);
-                    int move = encode_move(src, ep_target, piece, 0, 1, 0, 1, 0);
-                    add_move(moves, move);
+                    int move = encode_move(src, ep_target, piece, 0, 1, (side == WHITE) ? p : P, 0, 1, 0);
+                    // Removing both pawns from the rank can expose the king, so en passant is tested directly
+                    if (is_legal_move(move, board)) {
+                        add_move(moves, move);
+                    }
                 }
             }
         }
@@ -137,7 +259,7 @@ void generate_castling_moves(int side, Moves *moves, Board *board) {
     if ((side == WHITE && (board->castle & WK)) || (side == BLACK && (board->castle & BK))) {
         if (!GET_BIT(board->occupancies[BOTH], k_pass) && !GET_BIT(board->occupancies[BOTH], k_target)) {
             if (!is_square_attacked(src, opponent, board) && !is_square_attacked(k_pass, opponent, board) && !is_square_attacked(k_target, opponent, board)) {
-                int move = encode_move(src, k_target, piece, 0, 0, 0, 0, 1);
+                int move = encode_move(src, k_target, piece, 0, 0, 0, 0, 0, 1);
                 add_move(moves, move);
             }
         }
@@ -147,35 +269,36 @@ void generate_castling_moves(int side, Moves *moves, Board *board) {
     if ((side == WHITE && (board->castle & WQ)) || (side == BLACK && (board->castle & BQ))) {
         if (!GET_BIT(board->occupancies[BOTH], q_pass) && !GET_BIT(board->occupancies[BOTH], q_target) && !GET_BIT(board->occupancies[BOTH], q_pass_second)) {
             if (!is_square_attacked(src, opponent, board) && !is_square_attacked(q_pass, opponent, board) && !is_square_attacked(q_target, opponent, board)) {
-                int move = encode_move(src, q_target, piece, 0, 0, 0, 0, 1);
+                int move = encode_move(src, q_target, piece, 0, 0, 0, 0, 0, 1);
                 add_move(moves, move);
             }
         }
     }
 }
 
-void generate_knight_moves(int side, Moves *moves, Board *board) {
+void generate_knight_moves(int side, MoveTargets *move_targets, Moves *moves, Board *board) {
     int piece = (side == WHITE) ? N : n;
     int src, target;
     int opponent = 1 - side;
 
-    Bitboard bitboard = board->bitboards[piece];
+    // A pinned knight can never move
+    Bitboard bitboard = board->bitboards[piece] & ~move_targets->pinned;
 
     while (bitboard) {
         src = get_least_sig_bit_index(bitboard);
 
-        Bitboard attacks = board->knight_attacks[src] & (~board->occupancies[side]);
+        Bitboard attacks = knight_attacks[src] & move_targets->targets;
 
         while (attacks) {
             target = get_least_sig_bit_index(attacks);
 
             if (GET_BIT(board->occupancies[opponent], target)) {
                 // capture
-                int move = encode_move(src, target, piece, 0, 1, 0, 0, 0);
+                int move = encode_move(src, target, piece, 0, 1, board->mailbox[target], 0, 0, 0);
                 add_move(moves, move);
             } else {
                 // normal
-                int move = encode_move(src, target, piece, 0, 0, 0, 0, 0);
+                int move = encode_move(src, target, piece, 0, 0, 0, 0, 0, 0);
                 add_move(moves, move);
             }
 
@@ -185,7 +308,7 @@ void generate_knight_moves(int side, Moves *moves, Board *board) {
     }
 }
 
-void generate_bishop_moves(int side, Moves *moves, Board *board) {
+void generate_bishop_moves(int side, MoveTargets *move_targets, Moves *moves, Board *board) {
     int piece = (side == WHITE) ? B : b;
     int src, target;
     int opponent = 1 - side;
@@ -195,18 +318,18 @@ void generate_bishop_moves(int side, Moves *moves, Board *board) {
     while (bitboard) {
         src = get_least_sig_bit_index(bitboard);
 
-        Bitboard attacks = get_bishop_attacks(src, board->occupancies[BOTH], board) & (~board->occupancies[side]);
+        Bitboard attacks = get_bishop_attacks(src, board->occupancies[BOTH]) & move_targets->targets & pin_mask(src, move_targets);
 
         while (attacks) {
             target = get_least_sig_bit_index(attacks);
 
             if (GET_BIT(board->occupancies[opponent], target)) {
                 // capture
-                int move = encode_move(src, target, piece, 0, 1, 0, 0, 0);
+                int move = encode_move(src, target, piece, 0, 1, board->mailbox[target], 0, 0, 0);
                 add_move(moves, move);
             } else {
                 // normal
-                int move = encode_move(src, target, piece, 0, 0, 0, 0, 0);
+                int move = encode_move(src, target, piece, 0, 0, 0, 0, 0, 0);
                 add_move(moves, move);
             }
 
@@ -216,7 +339,7 @@ void generate_bishop_moves(int side, Moves *moves, Board *board) {
     }
 }
 
-void generate_rook_moves(int side, Moves *moves, Board *board) {
+void generate_rook_moves(int side, MoveTargets *move_targets, Moves *moves, Board *board) {
     int piece = (side == WHITE) ? R : r;
     int src, target;
     int opponent = 1 - side;
@@ -226,18 +349,18 @@ void generate_rook_moves(int side, Moves *moves, Board *board) {
     while (bitboard) {
         src = get_least_sig_bit_index(bitboard);
 
-        Bitboard attacks = get_rook_attacks(src, board->occupancies[BOTH], board) & (~board->occupancies[side]);
+        Bitboard attacks = get_rook_attacks(src, board->occupancies[BOTH]) & move_targets->targets & pin_mask(src, move_targets);
 
         while (attacks) {
             target = get_least_sig_bit_index(attacks);
 
             if (GET_BIT(board->occupancies[opponent], target)) {
                 // capture
-                int move = encode_move(src, target, piece, 0, 1, 0, 0, 0);
+                int move = encode_move(src, target, piece, 0, 1, board->mailbox[target], 0, 0, 0);
                 add_move(moves, move);
             } else {
                 // normal
-                int move = encode_move(src, target, piece, 0, 0, 0, 0, 0);
+                int move = encode_move(src, target, piece, 0, 0, 0, 0, 0, 0);
                 add_move(moves, move);
             }
 
@@ -247,7 +370,7 @@ void generate_rook_moves(int side, Moves *moves, Board *board) {
     }
 }
 
-void generate_queen_moves(int side, Moves *moves, Board *board) {
+void generate_queen_moves(int side, MoveTargets *move_targets, Moves *moves, Board *board) {
     int piece = (side == WHITE) ? Q : q;
     int src, target;
     int opponent = 1 - side;
@@ -257,18 +380,18 @@ void generate_queen_moves(int side, Moves *moves, Board *board) {
     while (bitboard) {
         src = get_least_sig_bit_index(bitboard);
 
-        Bitboard attacks = get_queen_attacks(src, board->occupancies[BOTH], board) & (~board->occupancies[side]);
+        Bitboard attacks = get_queen_attacks(src, board->occupancies[BOTH]) & move_targets->targets & pin_mask(src, move_targets);
 
         while (attacks) {
             target = get_least_sig_bit_index(attacks);
 
             if (GET_BIT(board->occupancies[opponent], target)) {
                 // capture
-                int move = encode_move(src, target, piece, 0, 1, 0, 0, 0);
+                int move = encode_move(src, target, piece, 0, 1, board->mailbox[target], 0, 0, 0);
                 add_move(moves, move);
             } else {
                 // normal
-                int move = encode_move(src, target, piece, 0, 0, 0, 0, 0);
+                int move = encode_move(src, target, piece, 0, 0, 0, 0, 0, 0);
                 add_move(moves, move);
             }
 
@@ -278,62 +401,98 @@ void generate_queen_moves(int side, Moves *moves, Board *board) {
     }
 }
 
-void generate_king_moves(int side, Moves *moves, Board *board) {
+void generate_king_moves(int side, MoveTargets *move_targets, Moves *moves, Board *board) {
     int piece = (side == WHITE) ? K : k;
-    int src, target;
+    int src = move_targets->king_square;
+    int target;
     int opponent = 1 - side;
 
-    Bitboard bitboard = board->bitboards[piece];
-
-    while (bitboard) {
-        src = get_least_sig_bit_index(bitboard);
+    // The king is removed so squares behind it on a slider's line are seen as attacked
+    Bitboard occupancy = board->occupancies[BOTH] ^ (1ULL << src);
+    Bitboard attacks = king_attacks[src] & move_targets->king_targets;
 
-        Bitboard attacks = board->king_attacks[src] & (~board->occupancies[side]);
+    while (attacks) {
+        target = get_least_sig_bit_index(attacks);
+        POP_BIT(attacks, target);
 
-        while (attacks) {
-            target = get_least_sig_bit_index(attacks);
-
-            if (GET_BIT(board->occupancies[opponent], target)) {
-                // capture
-                int move = encode_move(src, target, piece, 0, 1, 0, 0, 0);
-                add_move(moves, move);
-            } else {
-                // normal
-                int move = encode_move(src, target, piece, 0, 0, 0, 0, 0);
-                add_move(moves, move);
-            }
+        if (is_square_attacked_through(target, opponent, occupancy, board)) {
+            continue;
+        }
 
-            POP_BIT(attacks, target);
+        if (GET_BIT(board->occupancies[opponent], target)) {
+            // capture
+            int move = encode_move(src, target, piece, 0, 1, board->mailbox[target], 0, 0, 0);
+            add_move(moves, move);
+        } else {
+            // normal
+            int move = encode_move(src, target, piece, 0, 0, 0, 0, 0, 0);
+            add_move(moves, move);
         }
-        POP_BIT(bitboard, src);
     }
 }
 
-int is_square_attacked(int square, int side, Board *board) {
+// Whether side attacks square when the board has the given occupancy.
+int is_square_attacked_through(int square, int side, Bitboard occupancy, Board *board) {
     int opponent = (side == WHITE) ? BLACK : WHITE;
     int offset = (side == WHITE) ? 0 : 6;
-    
-    if (board->pawn_attacks[opponent][square] & board->bitboards[P + offset]) return 1;
-    if (board->knight_attacks[square] & board->bitboards[N + offset]) return 1;
-    if (get_bishop_attacks(square, board->occupancies[BOTH], board) & board->bitboards[B + offset]) return 1;
-    if (get_rook_attacks(square, board->occupancies[BOTH], board) & board->bitboards[R + offset]) return 1;    
-    if (get_queen_attacks(square, board->occupancies[BOTH], board) & board->bitboards[Q + offset]) return 1;
-    if (board->king_attacks[square] & board->bitboards[K + offset]) return 1;
-    
+
+    if (pawn_attacks[opponent][square] & board->bitboards[P + offset]) return 1;
+    if (knight_attacks[square] & board->bitboards[N + offset]) return 1;
+    if (get_bishop_attacks(square, occupancy) & (board->bitboards[B + offset] | board->bitboards[Q + offset])) return 1;
+    if (get_rook_attacks(square, occupancy) & (board->bitboards[R + offset] | board->bitboards[Q + offset])) return 1;
+    if (king_attacks[square] & board->bitboards[K + offset]) return 1;
+
     return 0;
 }
 
-Bitboard get_attackers_to_square(int target_square, int side, Bitboard occupancy[], Bitboard bitboards[], Board *board) {
+int is_square_attacked(int square, int side, Board *board) {
+    return is_square_attacked_through(square, side, board->occupancies[BOTH], board);
+}
+
+/**
+ * Whether a pseudo-legal move leaves the moving side's king safe.
+ * The move is applied to the occupancy only: the captured piece is ignored as an attacker and sliders see through the source square.
+ * Castling is only generated when it is legal, so it is always accepted.
+ */
+int is_legal_move(int move, Board *board) {
+    if (MOVE_CASTLE(move)) {
+        return 1;
+    }
+
+    int side = board->side;
+    int offset = (side == WHITE) ? 6 : 0;
+    int src = MOVE_SRC(move);
+    int target = MOVE_TARGET(move);
+    int piece = MOVE_PIECE(move);
+    int king_square = (piece == K || piece == k) ? target : get_least_sig_bit_index(board->bitboards[(side == WHITE) ? K : k]);
+
+    Bitboard captured = 1ULL << target;
+    if (MOVE_ENPASSANT(move)) {
+        captured |= 1ULL << (target + ((side == WHITE) ? 8 : -8));
+    }
+    Bitboard occupancy = (board->occupancies[BOTH] ^ (1ULL << src) ^ captured) | (1ULL << target);
+    Bitboard remaining = ~captured;
+
+    if (pawn_attacks[side][king_square] & board->bitboards[P + offset] & remaining) return 0;
+    if (knight_attacks[king_square] & board->bitboards[N + offset] & remaining) return 0;
+    if (get_bishop_attacks(king_square, occupancy) & (board->bitboards[B + offset] | board->bitboards[Q + offset]) & remaining) return 0;
+    if (get_rook_attacks(king_square, occupancy) & (board->bitboards[R + offset] | board->bitboards[Q + offset]) & remaining) return 0;
+    if (king_attacks[king_square] & board->bitboards[K + offset]) return 0;
+
+    return 1;
+}
+
+Bitboard get_attackers_to_square(int target_square, int side, Bitboard occupancy[], Bitboard bitboards[]) {
     Bitboard attackers = 0ULL;
     int offset = (side == WHITE) ? 0 : 6;
 
     // Get attackers for the provided side to the target square
-    attackers |= board->pawn_attacks[side][target_square] & occupancy[side^1];
-    attackers |= board->knight_attacks[target_square] & bitboards[N + offset];
-    attackers |= get_bishop_attacks(target_square, occupancy[BOTH], board) & bitboards[B + offset];
-    attackers |= get_rook_attacks(target_square, occupancy[BOTH], board) & bitboards[R + offset];   
-    attackers |= get_queen_attacks(target_square, occupancy[BOTH], board) & bitboards[Q + offset];
-    attackers |= board->king_attacks[target_square] & bitboards[K + offset];
+    attackers |= pawn_attacks[side ^ 1][target_square] & bitboards[P + offset];
+    attackers |= knight_attacks[target_square] & bitboards[N + offset];
+    attackers |= get_bishop_attacks(target_square, occupancy[BOTH]) & bitboards[B + offset];
+    attackers |= get_rook_attacks(target_square, occupancy[BOTH]) & bitboards[R + offset];   
+    attackers |= get_queen_attacks(target_square, occupancy[BOTH]) & bitboards[Q + offset];
+    attackers |= king_attacks[target_square] & bitboards[K + offset];
 
     return attackers;
 }
@@ -343,8 +502,47 @@ void add_move(Moves *move_list, int move) {
     move_list->count++;
 }
 
-int make_move(int move, Board *board) {
-    COPY_BOARD(board);
+// The rook squares of a castling move, given the king's target square.
+static inline void get_castling_rook_squares(int target, int *rook_src, int *rook_target) {
+    switch (target) {
+        case g1: *rook_src = h1; *rook_target = f1; break;
+        case c1: *rook_src = a1; *rook_target = d1; break;
+        case g8: *rook_src = h8; *rook_target = f8; break;
+        default: *rook_src = a8; *rook_target = d8; break;
+    }
+}
+
+/**
+ * Lists the pieces a move places and removes, as piece * 64 + square, for the network accumulators.
+ * A move places and removes at most two pieces each.
+ */
+static void move_features(int move, int side, int *added, int *added_count, int *removed, int *removed_count) {
+    int target = MOVE_TARGET(move);
+    int piece = MOVE_PIECE(move);
+    int promoted = MOVE_PROMOTED(move);
+    removed[0] = piece * 64 + MOVE_SRC(move);
+    added[0] = (promoted ? promoted : piece) * 64 + target;
+    *removed_count = 1;
+    *added_count = 1;
+
+    if (MOVE_CAPTURE(move)) {
+        int capture_square = MOVE_ENPASSANT(move) ? target + ((side == WHITE) ? 8 : -8) : target;
+        removed[(*removed_count)++] = MOVE_CAPTURED(move) * 64 + capture_square;
+    }
+    if (MOVE_CASTLE(move)) {
+        int rook_src, rook_target;
+        int rook_piece = (side == WHITE) ? R : r;
+        get_castling_rook_squares(target, &rook_src, &rook_target);
+        removed[(*removed_count)++] = rook_piece * 64 + rook_src;
+        added[(*added_count)++] = rook_piece * 64 + rook_target;
+    }
+}
+
+/**
+ * Moves are generated legal, so the king is never left in check and the move is not tested here.
+ * The state needed to take the move back is pushed onto board->states for unmake_move().
+ */
+void make_move(int move, Board *board) {
 
     int src = MOVE_SRC(move);
     int target = MOVE_TARGET(move);
@@ -352,6 +550,15 @@ int make_move(int move, Board *board) {
     int side = board->side;
     int opponent = side ^ 1;
 
+    BoardState *state = &board->states[board->repetition_index];
+    state->hash_key = board->hash_key;
+    state->pawn_key = board->pawn_key;
+    state->material_key = board->material_key;
+    state->enpassant = board->enpassant;
+    state->castle = board->castle;
+    state->fifty_move_rule_counter = board->fifty_move_rule_counter;
+    state->scores = board->scores;
+
     // Move piece from source to target
     POP_BIT(board->bitboards[piece], src);
     SET_BIT(board->bitboards[piece], target);
@@ -360,8 +567,12 @@ int make_move(int move, Board *board) {
     POP_BIT(board->occupancies[side], src);
     SET_BIT(board->occupancies[side], target);
 
+    board->mailbox[src] = -1;
+    board->mailbox[target] = piece;
+
     board->hash_key ^= piece_keys[piece][src];
     board->hash_key ^= piece_keys[piece][target];
+    move_piece_score(&board->scores, piece, src, target);
 
     // Increment 50 move rule counter.
     board->fifty_move_rule_counter++;
@@ -369,24 +580,27 @@ int make_move(int move, Board *board) {
     // Pawn moves reset the 50 move rule.
     if (piece == P || piece == p) {
         board->fifty_move_rule_counter = 0;
+        board->pawn_key ^= piece_keys[piece][src];
+        board->pawn_key ^= piece_keys[piece][target];
     }
 
     // Capture moves
     if (MOVE_CAPTURE(move)) {
         // Captures reset the 50 move rule.
         board->fifty_move_rule_counter = 0;
-        int captured_piece;
-        int start = (side == WHITE) ? p : P;
-        int end = (side == WHITE) ? k : K;
-
-        for (captured_piece = start; captured_piece <= end; captured_piece++) {
-            if (GET_BIT(board->bitboards[captured_piece], target)) {
-                POP_BIT(board->bitboards[captured_piece], target);
-                board->hash_key ^= piece_keys[captured_piece][target];
-                break;
+
+        // En passant targets an empty square. The pawn is removed below.
+        if (!MOVE_ENPASSANT(move)) {
+            int captured_piece = MOVE_CAPTURED(move);
+            POP_BIT(board->bitboards[captured_piece], target);
+            POP_BIT(board->occupancies[opponent], target);
+            board->hash_key ^= piece_keys[captured_piece][target];
+            remove_piece_score(&board->scores, captured_piece, target);
+            board->material_key ^= piece_keys[captured_piece][count_bits(board->bitboards[captured_piece])];
+            if (captured_piece == P || captured_piece == p) {
+                board->pawn_key ^= piece_keys[captured_piece][target];
             }
         }
-        POP_BIT(board->occupancies[opponent], target);
     }
 
     // Promotion Move
@@ -395,8 +609,14 @@ int make_move(int move, Board *board) {
         int promoted_piece = MOVE_PROMOTED(move);
         POP_BIT(board->bitboards[pawn_bb], target);
         SET_BIT(board->bitboards[promoted_piece], target);
+        board->mailbox[target] = promoted_piece;
         board->hash_key ^= piece_keys[pawn_bb][target];
         board->hash_key ^= piece_keys[promoted_piece][target];
+        board->pawn_key ^= piece_keys[pawn_bb][target];
+        remove_piece_score(&board->scores, pawn_bb, target);
+        add_piece_score(&board->scores, promoted_piece, target);
+        board->material_key ^= piece_keys[pawn_bb][count_bits(board->bitboards[pawn_bb])];
+        board->material_key ^= piece_keys[promoted_piece][count_bits(board->bitboards[promoted_piece]) - 1];
     }
 
     // En passant
@@ -406,7 +626,11 @@ int make_move(int move, Board *board) {
         int ep_capture_square = target + target_adj;
         POP_BIT(board->bitboards[pawn_bb], ep_capture_square);
         POP_BIT(board->occupancies[opponent], ep_capture_square);
+        board->mailbox[ep_capture_square] = -1;
         board->hash_key ^= piece_keys[pawn_bb][ep_capture_square];
+        board->pawn_key ^= piece_keys[pawn_bb][ep_capture_square];
+        remove_piece_score(&board->scores, pawn_bb, ep_capture_square);
+        board->material_key ^= piece_keys[pawn_bb][count_bits(board->bitboards[pawn_bb])];
     }
 
     if (board->enpassant != na) {
@@ -424,22 +648,18 @@ int make_move(int move, Board *board) {
 
     // Castling
     if (MOVE_CASTLE(move)) {
-        int rook_src, rook_target, rook_piece;
-        if (target == g1 || target == g8) { // King-side castling
-            rook_src = (side == WHITE) ? h1 : h8;
-            rook_target = (side == WHITE) ? f1 : f8;
-            rook_piece = (side == WHITE) ? R : r;
-        } else { // Queen-side castling
-            rook_src = (side == WHITE) ? a1 : a8;
-            rook_target = (side == WHITE) ? d1 : d8;
-            rook_piece = (side == WHITE) ? R : r;
-        }
+        int rook_src, rook_target;
+        int rook_piece = (side == WHITE) ? R : r;
+        get_castling_rook_squares(target, &rook_src, &rook_target);
         POP_BIT(board->bitboards[rook_piece], rook_src);
         SET_BIT(board->bitboards[rook_piece], rook_target);
         POP_BIT(board->occupancies[side], rook_src);
         SET_BIT(board->occupancies[side], rook_target);
+        board->mailbox[rook_src] = -1;
+        board->mailbox[rook_target] = rook_piece;
         board->hash_key ^= piece_keys[rook_piece][rook_src];
         board->hash_key ^= piece_keys[rook_piece][rook_target];
+        move_piece_score(&board->scores, rook_piece, rook_src, rook_target);
     }
 
     board->hash_key ^= castling_keys[board->castle];
@@ -453,6 +673,12 @@ int make_move(int move, Board *board) {
     // Update overall occupancy table
     board->occupancies[BOTH] = board->occupancies[WHITE] | board->occupancies[BLACK];
 
+    if (nnue_enabled) {
+        int added[2], removed[2], added_count, removed_count;
+        move_features(move, side, added, &added_count, removed, &removed_count);
+        update_accumulators(board, added, added_count, removed, removed_count);
+    }
+
     // Change side
     board->side ^= 1;
 
@@ -461,13 +687,88 @@ int make_move(int move, Board *board) {
     // Store position in repetition table to detect 3 fold repetition 
     board->repetition_index++;
     board->repetition_table[board->repetition_index] = board->hash_key;
+}
 
-    // Ensure King is not in Check
-    if (is_square_attacked(get_least_sig_bit_index((board->side == WHITE) ? board->bitboards[k] : board->bitboards[K]), board->side, board)) {
-        UNDO(board);
-        return 0;
+// Takes back the last move made with make_move(). move must be that same move.
+void unmake_move(int move, Board *board) {
+    board->repetition_index--;
+    BoardState *state = &board->states[board->repetition_index];
+
+    board->side ^= 1;
+    int side = board->side;
+    int opponent = side ^ 1;
+    int src = MOVE_SRC(move);
+    int target = MOVE_TARGET(move);
+    int piece = MOVE_PIECE(move);
+    int promoted = MOVE_PROMOTED(move);
+
+    // Move piece back from target to source
+    POP_BIT(board->bitboards[promoted ? promoted : piece], target);
+    SET_BIT(board->bitboards[piece], src);
+    POP_BIT(board->occupancies[side], target);
+    SET_BIT(board->occupancies[side], src);
+    board->mailbox[src] = piece;
+    board->mailbox[target] = -1;
+
+    if (MOVE_CAPTURE(move)) {
+        int captured_piece = MOVE_CAPTURED(move);
+        int capture_square = MOVE_ENPASSANT(move) ? target + ((side == WHITE) ? 8 : -8) : target;
+        SET_BIT(board->bitboards[captured_piece], capture_square);
+        SET_BIT(board->occupancies[opponent], capture_square);
+        board->mailbox[capture_square] = captured_piece;
     }
-    return 1;
+
+    if (MOVE_CASTLE(move)) {
+        int rook_src, rook_target;
+        int rook_piece = (side == WHITE) ? R : r;
+        get_castling_rook_squares(target, &rook_src, &rook_target);
+        POP_BIT(board->bitboards[rook_piece], rook_target);
+        SET_BIT(board->bitboards[rook_piece], rook_src);
+        POP_BIT(board->occupancies[side], rook_target);
+        SET_BIT(board->occupancies[side], rook_src);
+        board->mailbox[rook_target] = -1;
+        board->mailbox[rook_src] = rook_piece;
+    }
+
+    board->occupancies[BOTH] = board->occupancies[WHITE] | board->occupancies[BLACK];
+
+    // The accumulators are not saved in the state, so the move's features are applied in reverse
+    if (nnue_enabled) {
+        int added[2], removed[2], added_count, removed_count;
+        move_features(move, side, added, &added_count, removed, &removed_count);
+        update_accumulators(board, removed, removed_count, added, added_count);
+    }
+
+    board->hash_key = state->hash_key;
+    board->pawn_key = state->pawn_key;
+    board->material_key = state->material_key;
+    board->enpassant = state->enpassant;
+    board->castle = state->castle;
+    board->fifty_move_rule_counter = state->fifty_move_rule_counter;
+    board->scores = state->scores;
+}
+
+// Passes the turn for null move pruning. The position before the null move is recorded for repetition detection.
+void make_null_move(Board *board) {
+    BoardState *state = &board->states[board->repetition_index];
+    state->hash_key = board->hash_key;
+    state->enpassant = board->enpassant;
+
+    board->repetition_index++;
+    board->repetition_table[board->repetition_index] = board->hash_key;
+
+    if (board->enpassant != na) board->hash_key ^= enpassant_keys[board->enpassant];
+    board->enpassant = na;
+    board->side ^= 1;
+    board->hash_key ^= side_key;
+}
+
+void unmake_null_move(Board *board) {
+    board->repetition_index--;
+    BoardState *state = &board->states[board->repetition_index];
+    board->side ^= 1;
+    board->hash_key = state->hash_key;
+    board->enpassant = state->enpassant;
 }
 
 int gives_check(Board *board, int move) {
@@ -482,27 +783,27 @@ int gives_check(Board *board, int move) {
     switch (piece) {
         case P:
         case p:
-            if (board->pawn_attacks[opponent][target] & king_bit) return 1;
+            if (pawn_attacks[opponent][target] & king_bit) return 1;
             break;
         case N:
         case n:
-            if (board->knight_attacks[target] & king_bit) return 1;
+            if (knight_attacks[target] & king_bit) return 1;
             break;
         case B:
         case b:
-            if (get_bishop_attacks(target, board->occupancies[BOTH], board) & king_bit) return 1;
+            if (get_bishop_attacks(target, board->occupancies[BOTH]) & king_bit) return 1;
             break;
         case R:
         case r:
-            if (get_rook_attacks(target, board->occupancies[BOTH], board) & king_bit) return 1;
+            if (get_rook_attacks(target, board->occupancies[BOTH]) & king_bit) return 1;
             break;
         case Q:
         case q:
-            if (get_queen_attacks(target, board->occupancies[BOTH], board) & king_bit) return 1;
+            if (get_queen_attacks(target, board->occupancies[BOTH]) & king_bit) return 1;
             break;
         case K:
         case k:
-            if (board->king_attacks[target] & king_bit) return 1;
+            if (king_attacks[target] & king_bit) return 1;
             break;
     }
 
@@ -511,26 +812,135 @@ int gives_check(Board *board, int move) {
         if (MOVE_ENPASSANT(move)) {
             int ep_capture_square = target + ((opponent == WHITE) ? 8 : -8);
             Bitboard occupancy_without_ep = board->occupancies[BOTH] ^ (1ULL << ep_capture_square);
-            if (get_rook_attacks(src, occupancy_without_ep, board) & king_bit) return 1;
-            if (get_bishop_attacks(src, occupancy_without_ep, board) & king_bit) return 1;
+            if (get_rook_attacks(src, occupancy_without_ep) & king_bit) return 1;
+            if (get_bishop_attacks(src, occupancy_without_ep) & king_bit) return 1;
         }
     }
 
     // Check if moving the piece opens an attack from a sliding piece
     Bitboard occupancy_without_src = board->occupancies[BOTH] ^ (1ULL << src);
-    if (get_rook_attacks(king_square, occupancy_without_src, board) & board->bitboards[(opponent == WHITE) ? R : r]) {
+    if (get_rook_attacks(king_square, occupancy_without_src) & board->bitboards[(opponent == WHITE) ? R : r]) {
         return 1;
     }
-    if (get_bishop_attacks(king_square, occupancy_without_src, board) & board->bitboards[(opponent == WHITE) ? B : b]) {
+    if (get_bishop_attacks(king_square, occupancy_without_src) & board->bitboards[(opponent == WHITE) ? B : b]) {
         return 1;
     }
-    if (get_queen_attacks(king_square, occupancy_without_src, board) & board->bitboards[(opponent == WHITE) ? Q : q]) {
+    if (get_queen_attacks(king_square, occupancy_without_src) & board->bitboards[(opponent == WHITE) ? Q : q]) {
         return 1;
     }
 
     return 0;
 }
 
+// Rebuilds the full move from a compact move if it is pseudo-legal in this position, otherwise returns 0.
+static int expand_pseudo_legal_move(int hash_move, Board *board) {
+
+    int src = MOVE_SRC(hash_move);
+    int target = MOVE_TARGET(hash_move);
+    int promoted = COMPACT_PROMOTED(hash_move);
+    int side = board->side;
+    int opponent = side ^ 1;
+
+    int piece = board->mailbox[src];
+    if (piece == -1 || (side == WHITE ? piece > K : piece < p)) {
+        return 0;
+    }
+
+    if (GET_BIT(board->occupancies[side], target)) {
+        return 0;
+    }
+
+    int capture = GET_BIT(board->occupancies[opponent], target) ? 1 : 0;
+    Bitboard target_bit = 1ULL << target;
+
+    // Only pawns can promote, and only to a piece of their own side
+    if (promoted && (piece % 6 != P || promoted > k || promoted % 6 == P || promoted % 6 == K || (side == WHITE ? promoted > K : promoted < p))) {
+        return 0;
+    }
+
+    switch (piece) {
+        case P:
+        case p: {
+            int direction = (side == WHITE) ? -8 : 8;
+            int promotion_rank = (side == WHITE) ? (target <= h8) : (target >= a1);
+            int start_rank = (side == WHITE) ? (src >= a2 && src <= h2) : (src >= a7 && src <= h7);
+
+            // Promotions must specify the promoted piece
+            if (promotion_rank != (promoted != 0)) {
+                return 0;
+            }
+
+            if (pawn_attacks[side][src] & target_bit) {
+                if (capture) {
+                    return encode_move(src, target, piece, promoted, 1, board->mailbox[target], 0, 0, 0);
+                }
+                if (target == board->enpassant) {
+                    return encode_move(src, target, piece, 0, 1, (side == WHITE) ? p : P, 0, 1, 0);
+                }
+                return 0;
+            }
+            if (capture || GET_BIT(board->occupancies[BOTH], src + direction)) {
+                return 0;
+            }
+            if (target == src + direction) {
+                return encode_move(src, target, piece, promoted, 0, 0, 0, 0, 0);
+            }
+            if (start_rank && target == src + 2 * direction && !GET_BIT(board->occupancies[BOTH], target)) {
+                return encode_move(src, target, piece, 0, 0, 0, 1, 0, 0);
+            }
+            return 0;
+        }
+        case N:
+        case n:
+            if (!(knight_attacks[src] & target_bit)) return 0;
+            break;
+        case B:
+        case b:
+            if (!(get_bishop_attacks(src, board->occupancies[BOTH]) & target_bit)) return 0;
+            break;
+        case R:
+        case r:
+            if (!(get_rook_attacks(src, board->occupancies[BOTH]) & target_bit)) return 0;
+            break;
+        case Q:
+        case q:
+            if (!(get_queen_attacks(src, board->occupancies[BOTH]) & target_bit)) return 0;
+            break;
+        case K:
+        case k:
+            if (!(king_attacks[src] & target_bit)) {
+                // Castling is the only king move to a square it does not attack
+                Moves castling_moves[1];
+                castling_moves->count = 0;
+                generate_castling_moves(side, castling_moves, board);
+                for (int i = 0; i < castling_moves->count; i++) {
+                    if (MOVE_TARGET(castling_moves->moves[i]) == target) {
+                        return castling_moves->moves[i];
+                    }
+                }
+                return 0;
+            }
+            break;
+    }
+
+    return encode_move(src, target, piece, 0, capture, capture ? board->mailbox[target] : 0, 0, 0, 0);
+}
+
+/**
+ * Restore the full move from the compact move stored in the transposition table.
+ * 
+ * Different positions can share a hash entry, so the stored move may not belong to this position.
+ * The move is only returned if it is legal in the current position, otherwise 0 is returned.
+ * This guarantees make_move() is never given a move that could not have been generated for this position.
+ */
+int expand_hash_move(int hash_move, Board *board) {
+    if (!hash_move) {
+        return 0;
+    }
+    int move = expand_pseudo_legal_move(hash_move, board);
+    return (move && is_legal_move(move, board)) ? move : 0;
+}
+
 
 void print_move(int move) {
     int promoted = MOVE_PROMOTED(move);
@@ -549,13 +959,13 @@ void print_move_list(Moves *move_list) {
     printf("\n\tPiece\tMove   Capture\tDouble\tEP\tCastling\n");
     for (int i = 0; i < move_list->count; i++) {
         int move = move_list->moves[i];
-    printf("%d.\t%c\t%s%s%c\t%d\t%d\t%d\t%d\n", 
+    printf("%d.\t%c\t%s%s%c\t%c\t%d\t%d\t%d\n", 
                     i+1, 
                     ascii_pieces[MOVE_PIECE(move)], 
                     square[MOVE_SRC(move)], 
                     square[MOVE_TARGET(move)], 
                     MOVE_PROMOTED(move) ? promoted_pieces[MOVE_PROMOTED(move)] : ' ', 
-                    MOVE_CAPTURE(move), 
+                    MOVE_CAPTURE(move) ? ascii_pieces[MOVE_CAPTURED(move)] : '-', 
                     MOVE_DOUBLE(move), 
                     MOVE_ENPASSANT(move),
                     MOVE_CASTLE(move));
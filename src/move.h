@@ -11,9 +11,11 @@
 #define DOUBLE 0x200000
 #define ENPASSANT 0x400000
 #define CASTLE 0x800000
+#define CAPTURED 0xf000000
 
-#define encode_move(src, target, piece, promoted, capture, double, enpassant, castle) \
-    (src) | (target << 6) | (piece << 12) | (promoted << 16) | (capture << 20) | (double << 21) | (enpassant << 22) | (castle << 23)
+// captured is the piece taken by a capture (the pawn for en passant), and 0 for other moves
+#define encode_move(src, target, piece, promoted, capture, captured, double, enpassant, castle) \
+    ((src) | ((target) << 6) | ((piece) << 12) | ((promoted) << 16) | ((capture) << 20) | ((double) << 21) | ((enpassant) << 22) | ((castle) << 23) | ((captured) << 24))
 
 #define MOVE_SRC(move) (move & SOURCE)
 #define MOVE_TARGET(move) ((move & TARGET) >> 6)
@@ -23,6 +25,12 @@
 #define MOVE_DOUBLE(move) ((move & DOUBLE) >> 21)
 #define MOVE_ENPASSANT(move) ((move & ENPASSANT) >> 22)
 #define MOVE_CASTLE(move) ((move & CASTLE) >> 23)
+#define MOVE_CAPTURED(move) ((move & CAPTURED) >> 24)
+
+// Compact 16-bit form of a move stored in the transposition table. 
+// The remaining flags are restored from the position by expand_hash_move().
+#define COMPACT_MOVE(move) (MOVE_SRC(move) | (MOVE_TARGET(move) << 6) | (MOVE_PROMOTED(move) << 12))
+#define COMPACT_PROMOTED(move) (((move) >> 12) & 0xf)
 
 typedef struct {
     int moves[256];
@@ -40,23 +48,40 @@ static const char promoted_pieces[] = {
     [n] = 'n',
 };
 
-enum {ALL_MOVES, CAPTURES };
+enum {ALL_MOVES, CAPTURES, QUIETS };
+
+// Squares the pieces of the side to move may move to, computed once per node by the move generator.
+typedef struct {
+    Bitboard targets;      // Knights and sliders
+    Bitboard pawn_targets;
+    Bitboard king_targets;
+    Bitboard pinned;       // Pieces pinned to their own king
+    int king_square;
+} MoveTargets;
 
 void print_move(int);
 void print_move_list(Moves*);
 void add_move(Moves*, int);
-int make_move(int, Board*);
+void make_move(int, Board*);
+void unmake_move(int, Board*);
+void make_null_move(Board*);
+void unmake_null_move(Board*);
 void generate_moves(Moves*, Board*);
-void generate_pawn_moves(int, Moves*, Board*);
+void generate_captures(Moves*, Board*);
+void generate_quiets(Moves*, Board*);
+void generate_pawn_moves(int, MoveTargets*, Moves*, Board*);
 void generate_castling_moves(int, Moves*, Board*);
-void generate_knight_moves(int, Moves*, Board*);
-void generate_bishop_moves(int, Moves*, Board*);
-void generate_rook_moves(int, Moves*, Board*);
-void generate_queen_moves(int, Moves*, Board*);
-void generate_king_moves(int, Moves*, Board*);
+void generate_knight_moves(int, MoveTargets*, Moves*, Board*);
+void generate_bishop_moves(int, MoveTargets*, Moves*, Board*);
+void generate_rook_moves(int, MoveTargets*, Moves*, Board*);
+void generate_queen_moves(int, MoveTargets*, Moves*, Board*);
+void generate_king_moves(int, MoveTargets*, Moves*, Board*);
 int gives_check(Board*, int);
+int expand_hash_move(int, Board*);
+int is_legal_move(int, Board*);
 
 int is_square_attacked(int, int, Board*);
-Bitboard get_attackers_to_square(int target_square, int side, Bitboard occupancy[], Bitboard bitboards[], Board *board);
+int is_square_attacked_through(int, int, Bitboard, Board*);
+Bitboard get_attackers_to_square(int target_square, int side, Bitboard occupancy[], Bitboard bitboards[]);
 
 #endif
\ No newline at end of file
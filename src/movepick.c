@@ -0,0 +1,271 @@
+#include <stdio.h>
+
+#include "movepick.h"
+#include "eval.h"
+#include "table.h"
+
+/******** Most valuable victim/least valuable attacker (MVV-LVA) ********
+ * When a less valuable piece captures a more valuable piece, 
+ * the move should have priority in the search order (eg PxQ).
+ * This helps hit the beta cutoff sooner, reducing the nodes searched. 
+ *                           
+ *  (Victim)    Pawn Knight Bishop   Rook  Queen   King
+ *  (Attacker)
+ *        Pawn   105    205    305    405    505    605
+ *      Knight   104    204    304    404    504    604
+ *      Bishop   103    203    303    403    503    603
+ *        Rook   102    202    302    402    502    602
+ *       Queen   101    201    301    401    501    601
+ *        King   100    200    300    400    500    600
+ *   
+ ***********************************************************************/
+
+// MVV LVA [attacker][victim]
+static int mvv_lva[12][12] = {
+	{105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605},
+	{104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604},
+	{103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603},
+	{102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602},
+	{101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601},
+	{100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600},
+
+	{105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605},
+	{104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604},
+	{103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603},
+	{102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602},
+	{101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601},
+	{100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600}
+};
+
+// Captures are scored by MVV-LVA. Promotions are scored as if the pawn captured the promoted piece.
+static inline int score_capture(int move) {
+    if (!MOVE_CAPTURE(move)) {
+        return mvv_lva[MOVE_PIECE(move)][MOVE_PROMOTED(move)];
+    }
+    // 10,000 is added to ensure capture moves will score higher priority than quiet killer moves
+    // This is because captures have a higher change of producing a cutoff.
+    return mvv_lva[MOVE_PIECE(move)][MOVE_CAPTURED(move)] + BONUS_CAPTURE;
+}
+
+// Quiet moves are scored by the History Heuristic
+static inline int score_quiet(int move, Search *search) {
+    return search->history[MOVE_PIECE(move)][MOVE_TARGET(move)];
+}
+
+// Used when in check, where all moves are generated up front and ordered together.
+static inline int score_evasion(int move, Search *search) {
+    if (MOVE_CAPTURE(move) || MOVE_PROMOTED(move)) {
+        return score_capture(move);
+    }
+    if (search->killer_moves[0][search->ply] == move) {
+        return BONUS_KILLER;
+    }
+    if (search->killer_moves[1][search->ply] == move) {
+        return BONUS_SECOND_KILLER;
+    }
+    return score_quiet(move, search);
+}
+
+/**
+ * A capture is bad if the Static Exchange Evaluation (SEE) shows it loses material.
+ * Captures of a piece worth at least as much as the capturing piece can never lose material, so SEE is skipped for them. 
+ * This includes every pawn capture, so en passant never needs SEE.
+ */
+static inline int is_bad_capture(int move, Board *board) {
+    if (!MOVE_CAPTURE(move) || MOVE_PROMOTED(move)) {
+        return 0;
+    }
+    int victim = MOVE_CAPTURED(move);
+    if (MATERIAL_SCORE[victim % 6] >= MATERIAL_SCORE[MOVE_PIECE(move) % 6]) {
+        return 0;
+    }
+    return see(board, MOVE_TARGET(move), MOVE_SRC(move)) < 0;
+}
+
+// A move from the transposition table or killer table is only used if it is pseudo-legal in this position
+static inline int is_valid_move(int move, Board *board) {
+    return move && expand_hash_move(COMPACT_MOVE(move), board) == move;
+}
+
+// Selection on demand: swap the best scored move in [current, end) to the front and return it.
+static inline int pick_best(MovePicker *picker, int end) {
+    int best = picker->current;
+    for (int i = picker->current + 1; i < end; i++) {
+        if (picker->scores[i] > picker->scores[best]) {
+            best = i;
+        }
+    }
+    int move = picker->moves[best];
+    int score = picker->scores[best];
+    picker->moves[best] = picker->moves[picker->current];
+    picker->scores[best] = picker->scores[picker->current];
+    picker->moves[picker->current] = move;
+    picker->scores[picker->current] = score;
+    picker->current++;
+    return move;
+}
+
+// Moves already returned by an earlier stage
+static inline int is_searched(MovePicker *picker, int move) {
+    return move == picker->hash_move || move == picker->pv_move;
+}
+
+static inline int is_killer(MovePicker *picker, int move) {
+    return move == picker->killer_moves[0] || move == picker->killer_moves[1];
+}
+
+// Appends the generated moves to the picker, starting at index start. Returns the index after the last move.
+static inline int add_moves(MovePicker *picker, Moves *move_list, int start) {
+    for (int i = 0; i < move_list->count; i++) {
+        picker->moves[start + i] = move_list->moves[i];
+    }
+    return start + move_list->count;
+}
+
+/**
+ * hash_move must already be expanded with expand_hash_move().
+ * In check, all moves are generated immediately so the number of evasions is known before the first move is returned.
+ */
+void init_move_picker(MovePicker *picker, Search *search, int hash_move, int check, int captures_only) {
+    Board *board = search->board;
+    picker->search = search;
+    picker->board = board;
+    picker->captures_only = captures_only;
+    picker->hash_move = hash_move;
+    picker->pv_move = 0;
+    picker->killer_moves[0] = 0;
+    picker->killer_moves[1] = 0;
+    picker->killer_index = 0;
+    picker->current = 0;
+    picker->end_bad_captures = 0;
+    picker->end_captures = 0;
+    picker->end_quiets = 0;
+    picker->stage = STAGE_HASH;
+
+    // Quiescence search only searches captures and promotions
+    if (captures_only && hash_move && !MOVE_CAPTURE(hash_move) && !MOVE_PROMOTED(hash_move)) {
+        picker->hash_move = 0;
+    }
+
+    // Follow the PV line from the previous iteration while the PV move is available
+    if (!captures_only && search->follow_pv) {
+        int pv_move = search->pv_table[0][search->ply];
+        search->follow_pv = is_valid_move(pv_move, board);
+        if (search->follow_pv && pv_move != picker->hash_move) {
+            picker->pv_move = pv_move;
+        }
+    }
+
+    if (check && !captures_only) {
+        Moves move_list[1];
+        generate_moves(move_list, board);
+        picker->end_quiets = add_moves(picker, move_list, 0);
+        for (int i = 0; i < picker->end_quiets; i++) {
+            int move = picker->moves[i];
+            if (move == picker->hash_move) {
+                picker->scores[i] = BONUS_HASH_MOVE;
+            } else if (move == picker->pv_move) {
+                picker->scores[i] = BONUS_PV_MOVE;
+            } else {
+                picker->scores[i] = score_evasion(move, search);
+            }
+        }
+        picker->stage = STAGE_EVASIONS;
+    }
+}
+
+// Returns the next move to search, or 0 when there are no moves left.
+int next_move(MovePicker *picker) {
+    Search *search = picker->search;
+    Board *board = picker->board;
+    int move;
+
+    switch (picker->stage) {
+        case STAGE_HASH:
+            picker->stage++;
+            if (picker->hash_move) {
+                return picker->hash_move;
+            }
+            // fall through
+        case STAGE_PV:
+            picker->stage++;
+            if (picker->pv_move) {
+                return picker->pv_move;
+            }
+            // fall through
+        case STAGE_GENERATE_CAPTURES: {
+            Moves move_list[1];
+            generate_captures(move_list, board);
+            picker->end_captures = add_moves(picker, move_list, 0);
+            for (int i = 0; i < picker->end_captures; i++) {
+                picker->scores[i] = score_capture(picker->moves[i]);
+            }
+            picker->stage++;
+        }
+            // fall through
+        case STAGE_GOOD_CAPTURES:
+            while (picker->current < picker->end_captures) {
+                move = pick_best(picker, picker->end_captures);
+                if (is_searched(picker, move)) {
+                    continue;
+                }
+                // Losing captures are searched after the quiet moves. Quiescence search does its own SEE pruning.
+                if (!picker->captures_only && is_bad_capture(move, board)) {
+                    picker->moves[picker->end_bad_captures++] = move;
+                    continue;
+                }
+                return move;
+            }
+            if (picker->captures_only) {
+                picker->stage = STAGE_DONE;
+                return 0;
+            }
+            picker->killer_moves[0] = search->killer_moves[0][search->ply];
+            picker->killer_moves[1] = search->killer_moves[1][search->ply];
+            picker->stage++;
+            // fall through
+        case STAGE_KILLERS:
+            while (picker->killer_index < 2) {
+                move = picker->killer_moves[picker->killer_index++];
+                if (!MOVE_CAPTURE(move) && !MOVE_PROMOTED(move) && !is_searched(picker, move) && is_valid_move(move, board)) {
+                    return move;
+                }
+            }
+            picker->stage++;
+            // fall through
+        case STAGE_GENERATE_QUIETS: {
+            Moves move_list[1];
+            generate_quiets(move_list, board);
+            picker->end_quiets = add_moves(picker, move_list, picker->end_captures);
+            picker->current = picker->end_captures;
+            for (int i = picker->end_captures; i < picker->end_quiets; i++) {
+                picker->scores[i] = score_quiet(picker->moves[i], search);
+            }
+            picker->stage++;
+        }
+            // fall through
+        case STAGE_QUIETS:
+            while (picker->current < picker->end_quiets) {
+                move = pick_best(picker, picker->end_quiets);
+                if (!is_searched(picker, move) && !is_killer(picker, move)) {
+                    return move;
+                }
+            }
+            picker->current = 0;
+            picker->stage++;
+            // fall through
+        case STAGE_BAD_CAPTURES:
+            if (picker->current < picker->end_bad_captures) {
+                return picker->moves[picker->current++];
+            }
+            picker->stage = STAGE_DONE;
+            return 0;
+        case STAGE_EVASIONS:
+            if (picker->current < picker->end_quiets) {
+                return pick_best(picker, picker->end_quiets);
+            }
+            picker->stage = STAGE_DONE;
+            return 0;
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef MOVEPICK_H
+#define MOVEPICK_H
+
+#include "search.h"
+
+// Move picker stages, in the order the moves are returned
+enum {
+    STAGE_HASH,
+    STAGE_PV,
+    STAGE_GENERATE_CAPTURES,
+    STAGE_GOOD_CAPTURES,
+    STAGE_KILLERS,
+    STAGE_GENERATE_QUIETS,
+    STAGE_QUIETS,
+    STAGE_BAD_CAPTURES,
+    STAGE_EVASIONS,
+    STAGE_DONE,
+};
+
+/**
+ * Returns the moves of a node one at a time, in stages.
+ * Most cut-nodes fail high on one of the first moves, so moves are only scored when their stage is reached
+ * and the best remaining move is selected on demand instead of sorting the whole list.
+ *
+ * The moves array holds, in order: bad captures, the captures, then the quiet moves.
+ * Bad captures are moved to the front of the array as they are found.
+ */
+typedef struct {
+    Search *search;
+    Board *board;
+    int stage;
+    int captures_only; // Quiescence search
+    int hash_move;
+    int pv_move;
+    int killer_moves[2];
+    int killer_index;
+    int current;
+    int end_bad_captures;
+    int end_captures;
+    int end_quiets;
+    int moves[256];
+    int scores[256];
+} MovePicker;
+
+void init_move_picker(MovePicker*, Search*, int, int, int);
+int next_move(MovePicker*);
+
+#endif
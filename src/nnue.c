@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nnue.h"
+#include "magics.h"
+
+// The SIMD kernels are only compiled on x86-64 with GCC or Clang, and selected by CPUID like the PEXT slider backend
+#if defined(__x86_64__) && defined(__GNUC__)
+#define NNUE_SIMD
+#include <immintrin.h>
+#endif
+
+int nnue_enabled = 0;
+int nnue_backend = NNUE_SCALAR;
+const char *nnue_backend_names[] = { "scalar", "sse2", "avx2" };
+char nnue_file[1024] = "";
+
+static int16_t feature_weights[NNUE_INPUTS][NNUE_HIDDEN];
+static int16_t feature_biases[NNUE_HIDDEN];
+static int16_t output_weights[2 * NNUE_HIDDEN];
+static int32_t output_bias;
+
+/***** Kernels *****
+ * add_features() adds the weights of the added features and subtracts the removed ones from an accumulator.
+ * output_sum() returns the dot product of the clipped accumulator with output weights.
+ ********************/
+
+static void add_features_scalar(int16_t *accumulator, const int *added, int added_count, const int *removed, int removed_count) {
+    for (int i = 0; i < added_count; i++) {
+        for (int j = 0; j < NNUE_HIDDEN; j++) {
+            accumulator[j] += feature_weights[added[i]][j];
+        }
+    }
+    for (int i = 0; i < removed_count; i++) {
+        for (int j = 0; j < NNUE_HIDDEN; j++) {
+            accumulator[j] -= feature_weights[removed[i]][j];
+        }
+    }
+}
+
+static int output_sum_scalar(const int16_t *accumulator, const int16_t *weights) {
+    int sum = 0;
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        int value = accumulator[i] < 0 ? 0 : accumulator[i] > NNUE_QA ? NNUE_QA : accumulator[i];
+        sum += value * weights[i];
+    }
+    return sum;
+}
+
+#ifdef NNUE_SIMD
+// SSE2 is part of x86-64, so these need no CPUID check
+static void add_features_sse2(int16_t *accumulator, const int *added, int added_count, const int *removed, int removed_count) {
+    __m128i *acc = (__m128i *)accumulator;
+    for (int i = 0; i < added_count; i++) {
+        const __m128i *weights = (const __m128i *)feature_weights[added[i]];
+        for (int j = 0; j < NNUE_HIDDEN / 8; j++) {
+            _mm_storeu_si128(&acc[j], _mm_add_epi16(_mm_loadu_si128(&acc[j]), _mm_loadu_si128(&weights[j])));
+        }
+    }
+    for (int i = 0; i < removed_count; i++) {
+        const __m128i *weights = (const __m128i *)feature_weights[removed[i]];
+        for (int j = 0; j < NNUE_HIDDEN / 8; j++) {
+            _mm_storeu_si128(&acc[j], _mm_sub_epi16(_mm_loadu_si128(&acc[j]), _mm_loadu_si128(&weights[j])));
+        }
+    }
+}
+
+static int output_sum_sse2(const int16_t *accumulator, const int16_t *weights) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i qa = _mm_set1_epi16(NNUE_QA);
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i value = _mm_loadu_si128((const __m128i *)&accumulator[i]);
+        value = _mm_min_epi16(_mm_max_epi16(value, zero), qa);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(value, _mm_loadu_si128((const __m128i *)&weights[i])));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+// Only called once CPUID reports AVX2
+__attribute__((target("avx2")))
+static void add_features_avx2(int16_t *accumulator, const int *added, int added_count, const int *removed, int removed_count) {
+    __m256i *acc = (__m256i *)accumulator;
+    for (int i = 0; i < added_count; i++) {
+        const __m256i *weights = (const __m256i *)feature_weights[added[i]];
+        for (int j = 0; j < NNUE_HIDDEN / 16; j++) {
+            _mm256_storeu_si256(&acc[j], _mm256_add_epi16(_mm256_loadu_si256(&acc[j]), _mm256_loadu_si256(&weights[j])));
+        }
+    }
+    for (int i = 0; i < removed_count; i++) {
+        const __m256i *weights = (const __m256i *)feature_weights[removed[i]];
+        for (int j = 0; j < NNUE_HIDDEN / 16; j++) {
+            _mm256_storeu_si256(&acc[j], _mm256_sub_epi16(_mm256_loadu_si256(&acc[j]), _mm256_loadu_si256(&weights[j])));
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static int output_sum_avx2(const int16_t *accumulator, const int16_t *weights) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i qa = _mm256_set1_epi16(NNUE_QA);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i value = _mm256_loadu_si256((const __m256i *)&accumulator[i]);
+        value = _mm256_min_epi16(_mm256_max_epi16(value, zero), qa);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(value, _mm256_loadu_si256((const __m256i *)&weights[i])));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+    return _mm_cvtsi128_si32(half);
+}
+#endif
+
+static void (*add_features)(int16_t*, const int*, int, const int*, int) = add_features_scalar;
+static int (*output_sum)(const int16_t*, const int16_t*) = output_sum_scalar;
+
+// Returns 0 if the backend is not supported on this CPU, leaving the current backend selected.
+int set_nnue_backend(int backend) {
+    if (backend == NNUE_SCALAR) {
+        add_features = add_features_scalar;
+        output_sum = output_sum_scalar;
+    }
+#ifdef NNUE_SIMD
+    else if (backend == NNUE_SSE2) {
+        add_features = add_features_sse2;
+        output_sum = output_sum_sse2;
+    }
+    else if (backend == NNUE_AVX2 && (__builtin_cpu_init(), __builtin_cpu_supports("avx2"))) {
+        add_features = add_features_avx2;
+        output_sum = output_sum_avx2;
+    }
+#endif
+    else {
+        return 0;
+    }
+    nnue_backend = backend;
+    return 1;
+}
+
+// Selects the widest kernels the CPU supports
+void init_nnue_backend() {
+    if (!set_nnue_backend(NNUE_AVX2) && !set_nnue_backend(NNUE_SSE2)) {
+        set_nnue_backend(NNUE_SCALAR);
+    }
+}
+
+/***** Accumulators *****/
+
+// Rebuilds both accumulators from the pieces on the board. Used when a position is set up.
+void refresh_accumulators(Board *board) {
+    for (int perspective = WHITE; perspective <= BLACK; perspective++) {
+        int features[32];
+        int count = 0;
+        memcpy(board->accumulator[perspective], feature_biases, sizeof(feature_biases));
+        for (int piece = P; piece <= k; piece++) {
+            Bitboard bitboard = board->bitboards[piece];
+            while (bitboard) {
+                int square = get_least_sig_bit_index(bitboard);
+                features[count++] = nnue_feature(perspective, piece, square);
+                if (count == 32) {
+                    add_features(board->accumulator[perspective], features, count, NULL, 0);
+                    count = 0;
+                }
+                POP_BIT(bitboard, square);
+            }
+        }
+        add_features(board->accumulator[perspective], features, count, NULL, 0);
+    }
+}
+
+/**
+ * Applies the pieces a move added and removed, each given as piece * 64 + square, to both accumulators.
+ * unmake_move() passes the same lists swapped.
+ */
+void update_accumulators(Board *board, const int *added, int added_count, const int *removed, int removed_count) {
+    for (int perspective = WHITE; perspective <= BLACK; perspective++) {
+        int added_features[2], removed_features[2];
+        for (int i = 0; i < added_count; i++) {
+            added_features[i] = nnue_feature(perspective, added[i] / 64, added[i] % 64);
+        }
+        for (int i = 0; i < removed_count; i++) {
+            removed_features[i] = nnue_feature(perspective, removed[i] / 64, removed[i] % 64);
+        }
+        add_features(board->accumulator[perspective], added_features, added_count, removed_features, removed_count);
+    }
+}
+
+// Returns 1 if the incrementally updated accumulators match a refresh
+int accumulators_match(Board *board) {
+    int16_t accumulator[2][NNUE_HIDDEN];
+    memcpy(accumulator, board->accumulator, sizeof(accumulator));
+    refresh_accumulators(board);
+    int match = memcmp(accumulator, board->accumulator, sizeof(accumulator)) == 0;
+    memcpy(board->accumulator, accumulator, sizeof(accumulator));
+    return match;
+}
+
+// Returns the evaluation from the side to move's point of view
+int nnue_evaluate(Board *board) {
+#ifdef DEBUG
+    if (!accumulators_match(board)) {
+        printf("    [ERROR] Incremental NNUE accumulators do not match the position!\n");
+        exit(EXIT_FAILURE);
+    }
+#endif
+    int side = board->side;
+    int sum = output_sum(board->accumulator[side], output_weights)
+        + output_sum(board->accumulator[side ^ 1], output_weights + NNUE_HIDDEN)
+        + output_bias;
+    long long score = (long long)sum * NNUE_SCALE / (NNUE_QA * NNUE_QB);
+    return score > NNUE_MAX_SCORE ? NNUE_MAX_SCORE : score < -NNUE_MAX_SCORE ? -NNUE_MAX_SCORE : (int)score;
+}
+
+/***** Networks *****/
+
+/**
+ * Loads a network file. Returns 0 and keeps the current evaluation if the file cannot be read or has the wrong layout.
+ * Boards must be set up again after a network is loaded, since their accumulators were built from the old weights.
+ */
+int load_network(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        printf("    [ERROR] Could not open network file %s\n", path);
+        return 0;
+    }
+
+    char magic[8];
+    unsigned int hidden = 0;
+    int valid = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+        && memcmp(magic, NNUE_MAGIC, sizeof(magic)) == 0
+        && fread(&hidden, sizeof(hidden), 1, file) == 1
+        && hidden == NNUE_HIDDEN;
+
+    // Read into copies so a truncated file leaves the current network untouched
+    static int16_t weights[NNUE_INPUTS][NNUE_HIDDEN];
+    static int16_t biases[NNUE_HIDDEN];
+    static int16_t outputs[2 * NNUE_HIDDEN];
+    int32_t bias;
+    valid = valid
+        && fread(weights, sizeof(weights), 1, file) == 1
+        && fread(biases, sizeof(biases), 1, file) == 1
+        && fread(outputs, sizeof(outputs), 1, file) == 1
+        && fread(&bias, sizeof(bias), 1, file) == 1;
+    fclose(file);
+
+    if (!valid) {
+        printf("    [ERROR] %s is not a network with %d hidden neurons\n", path, NNUE_HIDDEN);
+        return 0;
+    }
+    memcpy(feature_weights, weights, sizeof(weights));
+    memcpy(feature_biases, biases, sizeof(biases));
+    memcpy(output_weights, outputs, sizeof(outputs));
+    output_bias = bias;
+    snprintf(nnue_file, sizeof(nnue_file), "%s", path);
+    nnue_enabled = 1;
+    return 1;
+}
+
+// Goes back to the classical evaluation
+void unload_network() {
+    nnue_enabled = 0;
+    nnue_file[0] = '\0';
+}
+
+// Fills the network with small deterministic random weights. Used to test and time the network code without a trained net.
+void init_random_network(unsigned int seed) {
+    unsigned int state = seed ? seed : 1;
+    for (int i = 0; i < NNUE_INPUTS; i++) {
+        for (int j = 0; j < NNUE_HIDDEN; j++) {
+            feature_weights[i][j] = (int)(random_U32(&state) % 33) - 16;
+        }
+    }
+    for (int j = 0; j < NNUE_HIDDEN; j++) {
+        feature_biases[j] = random_U32(&state) % 64;
+    }
+    for (int j = 0; j < 2 * NNUE_HIDDEN; j++) {
+        output_weights[j] = (int)(random_U32(&state) % 65) - 32;
+    }
+    output_bias = 0;
+    snprintf(nnue_file, sizeof(nnue_file), "<random %u>", seed);
+    nnue_enabled = 1;
+}
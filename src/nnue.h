@@ -0,0 +1,58 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include "bitboard.h"
+
+/**
+ * Optional efficiently updatable neural network evaluation.
+ *
+ * The network has 768 inputs, one per piece and square, seen from each side's perspective:
+ * the side's own pieces come first and the board is flipped vertically for black.
+ * Each perspective feeds the same NNUE_HIDDEN accumulator weights. The accumulators live in the board and are
+ * updated by make_move() and unmake_move() with only the features the move changed, so the first layer costs a few
+ * vector adds per move instead of a full pass over the pieces.
+ * The side to move's accumulator and the opponent's are clipped to [0, NNUE_QA] and combined by a single output neuron.
+ *
+ * Network file layout, little endian:
+ *   "THOTHNN1", uint32 hidden size (must be NNUE_HIDDEN),
+ *   int16 feature weights [768][NNUE_HIDDEN], int16 feature biases [NNUE_HIDDEN],
+ *   int16 output weights [2 * NNUE_HIDDEN] (side to move first), int32 output bias.
+ * The output is scaled to centipawns by NNUE_SCALE / (NNUE_QA * NNUE_QB).
+ *
+ * No network is loaded by default, and the classical evaluation is used until one is set with the EvalFile option.
+ */
+#define NNUE_INPUTS 768
+#define NNUE_QA 255
+#define NNUE_QB 64
+#define NNUE_SCALE 400
+#define NNUE_MAGIC "THOTHNN1"
+#define NNUE_MAX_SCORE 20000 // Network scores are clamped well below mate scores
+
+// Accumulator update and output kernels. Each backend computes identical results.
+enum { NNUE_SCALAR, NNUE_SSE2, NNUE_AVX2 };
+
+extern int nnue_enabled;
+extern int nnue_backend;
+extern const char *nnue_backend_names[];
+extern char nnue_file[];
+
+int load_network(const char*);
+void unload_network();
+void init_random_network(unsigned int);
+int set_nnue_backend(int);
+void init_nnue_backend();
+void refresh_accumulators(Board*);
+void update_accumulators(Board*, const int*, int, const int*, int);
+int accumulators_match(Board*);
+int nnue_evaluate(Board*);
+
+// Feature index of a piece on a square from the given side's perspective
+static inline int nnue_feature(int perspective, int piece, int square) {
+    if (perspective == BLACK) {
+        piece = piece < 6 ? piece + 6 : piece - 6;
+        square ^= 56;
+    }
+    return piece * 64 + square;
+}
+
+#endif
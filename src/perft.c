@@ -19,15 +19,19 @@ void perft(int depth, Board* board) {
     generate_moves(move_list, board);
 
     for (int move_count = 0; move_count < move_list->count; move_count++) {   
-        COPY_BOARD(board);
-        if (!make_move(move_list->moves[move_count], board)) {
-            continue;
-        }
+        make_move(move_list->moves[move_count], board);
         perft(depth - 1, board);
-        UNDO(board);        
+        unmake_move(move_list->moves[move_count], board);
     }
 }
 
+// Returns the number of leaf nodes at the given depth
+Bitboard perft_nodes(int depth, Board* board) {
+    nodes = 0;
+    perft(depth, board);
+    return nodes;
+}
+
 int perft_test(char *fen, int depth, const unsigned long long *expected_values, Board* board) {
     load_fen(fen, board);
     nodes = 0;
@@ -38,23 +42,21 @@ int perft_test(char *fen, int depth, const unsigned long long *expected_values,
     generate_moves(move_list, board);
 
     for (int move_count = 0; move_count < move_list->count; move_count++) {
-        COPY_BOARD(board);
-        if (make_move(move_list->moves[move_count], board)) {
-            perft(depth - 1, board);
-            UNDO(board);
-
-            // Debug hash key generation
-            /*
-            Bitboard expected_hash = generate_hash_key(board);
-            if (board->hash_key != expected_hash) {
-                printf("Move: ");
-                print_move(move_list->moves[move_count]);
-                print_board(board);
-                printf("Expected hash key: %llx\n", expected_hash);
-                getchar();
-            }
-            */
+        make_move(move_list->moves[move_count], board);
+        perft(depth - 1, board);
+        unmake_move(move_list->moves[move_count], board);
+
+        // Debug hash key generation
+        /*
+        Bitboard expected_hash = generate_hash_key(board);
+        if (board->hash_key != expected_hash) {
+            printf("Move: ");
+            print_move(move_list->moves[move_count]);
+            print_board(board);
+            printf("Expected hash key: %llx\n", expected_hash);
+            getchar();
         }
+        */
     }
     long end = get_ms();
 
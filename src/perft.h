@@ -5,6 +5,7 @@
 #include "board.h"
 
 void perft(int, Board*);
+Bitboard perft_nodes(int, Board*);
 void perft_test(char*, int, const unsigned long long*, Board*);
 void perft_tests();
 
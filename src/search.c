@@ -1,8 +1,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stddef.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 #include "search.h"
+#include "movepick.h"
 #include "eval.h"
 #include "util.h"
 #include "uci.h"
@@ -11,50 +14,98 @@
 #define inf 1000000
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
-#define INSERTION_SORT_THRESHOLD 16
 
-int total_researches, hash_hits, beta_cutoff_count, delta_prune, 
+// Debug statistics are kept per thread. Only the main thread's statistics are reported.
+_Thread_local int total_researches, hash_hits, beta_cutoff_count, delta_prune, 
     see_prune, total_full_researches, null_prune, razor_prune,
     futility_prune, eval_prune;
 
-int search(int depth, Board *board) {
-    int start = get_ms();
-    
-    // Debug statistics
-    total_researches = 0;
-    hash_hits = 0;
-    beta_cutoff_count = 0;
-    delta_prune = 0;
-    see_prune = 0;
-    total_full_researches = 0;
-    null_prune = 0;
-    razor_prune = 0;
-    futility_prune = 0;
-    eval_prune = 0;
-    
-    int score = 0;
-    Search search = {0};
+// Number of threads used by the search, set with the UCI `Threads` option.
+int thread_count = 1;
 
-    search.ply = 0;
-    search.nodes = 0;
-    search.score_pv = 0;
-    search.follow_pv = 0;
-    search.stopped = 0;
-    search.board = board;
+// Combined node count of the last search, used by the bench
+unsigned long long last_search_nodes = 0;
 
+/**
+ * Lazy SMP
+ * 
+ * Helper threads run their own iterative deepening on a private copy of the board.
+ * The threads do not communicate with each other directly. Instead, they share the transposition table,
+ * so the work done by one thread is picked up by the others through hash hits and better move ordering.
+ * The helpers search at varied depths so that they do not all follow the same path through the tree.
+ * Only the main thread reports info lines and the best move.
+ * Reference: https://www.chessprogramming.org/Lazy_SMP
+ */
+typedef struct {
+    Search search;
+    Board board;
+    int depth;
+    pthread_t thread;
+} SearchThread;
+
+static SearchThread *helpers = NULL;
+static int helper_count = 0;
+static atomic_int stop_helpers;
+
+// Combined node count for the main thread and all helper threads
+static unsigned long long total_nodes(Search *search) {
+    unsigned long long nodes = search->nodes;
+    for (int i = 0; i < helper_count; i++) {
+        nodes += helpers[i].search.nodes;
+    }
+    return nodes;
+}
+
+// Check for UCI input on the main thread. Helper threads stop when the main thread is done.
+static inline void check_stop(Search *search) {
+    if ((search->nodes & 2047) == 0) {
+        if (search->thread_id == 0) {
+            search->stopped = should_stop();
+        } else {
+            search->stopped = atomic_load_explicit(&stop_helpers, memory_order_relaxed);
+        }
+    }
+}
+
+static void print_info(int score, int depth, Search *search, int start) {
+    int time = get_ms() - start;
+    unsigned long long nodes = total_nodes(search);
+    unsigned long long nps = time > 0 ? nodes * 1000 / time : nodes;
+
+    if (score > -MATE_VALUE && score < -MATE_SCORE) {
+        printf("info score mate %d depth %d nodes %llu nps %llu time %d pv ", -(score + MATE_VALUE) / 2 - 1, depth, nodes, nps, time);
+    } else if (score > MATE_SCORE && score < MATE_VALUE) {
+        printf("info score mate %d depth %d nodes %llu nps %llu time %d pv ", (MATE_VALUE - score) / 2 + 1, depth, nodes, nps, time);   
+    } else {
+        printf("info score cp %d depth %d nodes %llu nps %llu time %d pv ", score, depth, nodes, nps, time);
+    }
+    for (int i = 0; i < search->pv_length[0]; i++) {
+        print_move(search->pv_table[0][i]);
+        printf(" ");
+    }
+    printf("\n");
+}
+
+static int iterative_deepening(int depth, Search *search, int start) {
+    int score = 0;
     int alpha = -inf;
     int beta = inf;
-    int current_depth = 1;
+
+    // Helper threads with an odd id start one ply deeper to spread the threads over different depths
+    int current_depth = 1 + (search->thread_id & 1);
+
+    select_pawn_table(search->thread_id);
+    select_material_table(search->thread_id);
 
     // Iterative deepening
     while (current_depth <= depth) {
 
-        if (search.stopped) {
+        if (search->stopped) {
             break;
         }
 
-        search.follow_pv = 1;
-        score = negamax(alpha, beta, current_depth, &search);
+        search->follow_pv = 1;
+        score = negamax(alpha, beta, current_depth, search);
 
         // Aspiration Window
         // Note - watch for search instability with this and adjust as needed.
@@ -76,31 +127,119 @@ int search(int depth, Board *board) {
         alpha = score - ASPIRATION_WINDOW;
         beta = score + ASPIRATION_WINDOW;
 
-        if (search.pv_length[0]) {
-            if (score > -MATE_VALUE && score < -MATE_SCORE) {
-                printf("info score mate %d depth %d nodes %lld time %d pv ", -(score + MATE_VALUE) / 2 - 1, current_depth, search.nodes, get_ms() - start);
-            } else if (score > MATE_SCORE && score < MATE_VALUE) {
-                printf("info score mate %d depth %d nodes %lld time %d pv ", (MATE_VALUE - score) / 2 + 1, current_depth, search.nodes, get_ms() - start);   
-            } else {
-                printf("info score cp %d depth %d nodes %lld time %d pv ", score, current_depth, search.nodes, get_ms() - start);
-            }
-            for (int i = 0; i < search.pv_length[0]; i++) {
-                print_move(search.pv_table[0][i]);
-                printf(" ");
+        if (search->pv_length[0]) {
+            if (search->thread_id == 0) {
+                print_info(score, current_depth, search, start);
             }
-            printf("\n");
             current_depth++;
         }
     }
+    return score;
+}
+
+static void *helper_search(void *arg) {
+    SearchThread *thread = (SearchThread *)arg;
+    iterative_deepening(thread->depth, &thread->search, get_ms());
+    return NULL;
+}
+
+static void start_helpers(int depth, Board *board) {
+    helper_count = 0;
+    if (thread_count <= 1) {
+        return;
+    }
+
+    helpers = (SearchThread *)malloc((thread_count - 1) * sizeof(SearchThread));
+    if (helpers == NULL) {
+        printf("    [ERROR] Error allocating %d helper threads!\n", thread_count - 1);
+        return;
+    }
+
+    atomic_store(&stop_helpers, 0);
+
+    for (int i = 0; i < thread_count - 1; i++) {
+        SearchThread *thread = &helpers[i];
+        memset(&thread->search, 0, sizeof(Search));
+        thread->board = *board;
+        thread->depth = depth;
+        thread->search.board = &thread->board;
+        thread->search.thread_id = i + 1;
+
+        if (pthread_create(&thread->thread, NULL, helper_search, thread) != 0) {
+            printf("    [ERROR] Error starting helper thread %d!\n", i + 1);
+            break;
+        }
+        helper_count++;
+    }
+}
+
+static void stop_and_join_helpers() {
+    atomic_store(&stop_helpers, 1);
+    for (int i = 0; i < helper_count; i++) {
+        pthread_join(helpers[i].thread, NULL);
+    }
+}
+
+static void free_helpers() {
+    free(helpers);
+    helpers = NULL;
+    helper_count = 0;
+}
+
+int search(int depth, Board *board) {
+    int start = get_ms();
+    
+    // Debug statistics
+    total_researches = 0;
+    hash_hits = 0;
+    tt_probes = 0;
+    tt_hits = 0;
+    pawn_probes = 0;
+    pawn_hits = 0;
+    eval_probes = 0;
+    eval_hits = 0;
+    lazy_evals = 0;
+    lazy_exits = 0;
+    beta_cutoff_count = 0;
+    delta_prune = 0;
+    see_prune = 0;
+    total_full_researches = 0;
+    null_prune = 0;
+    razor_prune = 0;
+    futility_prune = 0;
+    eval_prune = 0;
+    
+    Search search = {0};
+
+    search.ply = 0;
+    search.nodes = 0;
+    search.follow_pv = 0;
+    search.stopped = 0;
+    search.thread_id = 0;
+    search.board = board;
+
+    increment_hash_generation();
+    start_helpers(depth, board);
+
+    int score = iterative_deepening(depth, &search, start);
+
+    stop_and_join_helpers();
+
     printf("bestmove ");
     print_move(search.pv_table[0][0]);
     int time = get_ms() - start;
     printf("\n");
     printf("    [DEBUG] Total Time: %d\n", time);
-    printf("    [DEBUG] Nodes/s: %d\n", (int)(search.nodes / ((float)time / 1000)));
+    printf("    [DEBUG] Threads: %d\n", helper_count + 1);
+    printf("    [DEBUG] Nodes: %llu\n", total_nodes(&search));
+    printf("    [DEBUG] Nodes/s: %d\n", (int)(total_nodes(&search) / ((float)time / 1000)));
     printf("    [DEBUG] Total Full Re-searches: %d\n", total_full_researches);
     printf("    [DEBUG] Total Re-searches: %d\n", total_researches);
     printf("    [DEBUG] Hash hits: %d\n", hash_hits);
+    printf("    [DEBUG] Hash hit rate: %.2f%%\n", tt_probes ? 100.0 * tt_hits / tt_probes : 0.0);
+    printf("    [DEBUG] Pawn hash hit rate: %.2f%%\n", pawn_probes ? 100.0 * pawn_hits / pawn_probes : 0.0);
+    printf("    [DEBUG] Eval cache hits: %llu, misses: %llu\n", eval_hits, eval_probes - eval_hits);
+    printf("    [DEBUG] Lazy eval exits: %llu of %llu\n", lazy_exits, lazy_evals);
     printf("    [DEBUG] Beta Cut-offs: %d\n", beta_cutoff_count);
     printf("    [DEBUG] Delta Prune: %d\n", delta_prune);
     printf("    [DEBUG] SEE Prune: %d\n", see_prune);
@@ -109,6 +248,8 @@ int search(int depth, Board *board) {
     printf("    [DEBUG] Futility Prune: %d\n", futility_prune);
     printf("    [DEBUG] Eval Prune: %d\n", eval_prune);
 
+    last_search_nodes = total_nodes(&search);
+    free_helpers();
     return score;
 }
 
@@ -135,16 +276,18 @@ int negamax(int alpha, int beta, int depth, Search *search) {
     // If the move was already searched, return the score from the previous search
     // Only read from the hash table if it is not the root node and not the pv node.
     // In PVS, the PV node is defined as beta - alpha > 1.
+    // The best move from the hash entry is still used for move ordering when the score cannot be used.
     int is_pv = beta-alpha > 1;
-    if (search->ply && !is_pv && (score = probe_hash(board, alpha, beta, depth, search->ply)) != valueUNKNOWN) {
+    int hash_move;
+    score = probe_hash(board, alpha, beta, depth, search->ply, &hash_move);
+    if (search->ply && !is_pv && score != valueUNKNOWN) {
         hash_hits++;
         return score;
     }
+    hash_move = expand_hash_move(hash_move, board);
 
     // Check for UCI input
-    if ((search->nodes & 2047) == 0) {
-        search->stopped = should_stop();
-    }
+    check_stop(search);
 
     int moves_searched = 0;
 
@@ -187,17 +330,11 @@ int negamax(int alpha, int beta, int depth, Search *search) {
 
     // Null Move Pruning
     if (depth >= NULL_REDUCTION_LIMIT && !check && search->ply) {
-        COPY_BOARD(board);
         search->ply++;
-        board->repetition_index++;
-        board->repetition_table[board->repetition_index] = board->hash_key;
 
         // Give opponent a "null" move
-        if (board->enpassant != na) board->hash_key ^= enpassant_keys[board->enpassant];
-        board->enpassant = na;
-        board->side ^= 1;
-        board->hash_key ^= side_key;
-        
+        make_null_move(board);
+
         // Reduce more as depth increases
         int reduction = (depth > 6) ? 3 : 2;
 
@@ -205,7 +342,7 @@ int negamax(int alpha, int beta, int depth, Search *search) {
         score = -negamax(-beta, -beta+1, depth - 1 - reduction, search);
 
         search->ply--;
-        UNDO(board);
+        unmake_null_move(board);
 
         if (search->stopped) {
             return 0;
@@ -230,22 +367,22 @@ int negamax(int alpha, int beta, int depth, Search *search) {
         }
     }
 
-    Moves move_list[1];
-    generate_moves(move_list, board);
+    MovePicker picker[1];
+    init_move_picker(picker, search, hash_move, check, 0);
 
-    if (search->follow_pv) {
-        pv_scoring(move_list, search);
+    // Singular Reply Extension
+    // If there is only one move out of check, extend the search by 1 ply.
+    // The move count is only known up front in check, where the picker generates all evasions at once.
+    // Nodes with a single move outside of check are not extended, since counting their moves would
+    // mean generating every move before the hash move and captures are tried.
+    if (check && picker->end_quiets == 1) {
+        depth++;
     }
 
-    sort_moves(move_list, search);
-
-    for (int i = 0; i < move_list->count; i++) {
-        // Singular Reply Extension
-        // If there is only one legal move, extend the search by 1 ply.
-        if (move_list->count == 1) {
-            depth++;
-        }
+    int best_move = 0;
+    int move;
 
+    while ((move = next_move(picker))) {
         // Futility Pruning
         // If the static evaluation is much lower than alpha, it is unlikely that the position will be better than alpha.
         // This is because the position is already bad, and the search is unlikely to find a move that will improve the position.
@@ -257,21 +394,16 @@ int negamax(int alpha, int beta, int depth, Search *search) {
             && !check 
             && !gives_check
             && abs(alpha) < MATE_SCORE
-            && !MOVE_CAPTURE(move_list->moves[i])
-            && !MOVE_PROMOTED(move_list->moves[i])
+            && !MOVE_CAPTURE(move)
+            && !MOVE_PROMOTED(move)
             && static_eval + futility_margin[depth] <= alpha) {
                 futility_prune++;
                 continue;
         }
 
-        COPY_BOARD(board);
         search->ply++;
 
-        if (make_move(move_list->moves[i], board) == 0) {
-            // illegal move
-            search->ply--;
-            continue;
-        }
+        make_move(move, board);
         legal_move_count++;
          
         int score;
@@ -285,10 +417,10 @@ int negamax(int alpha, int beta, int depth, Search *search) {
                     && depth >= REDUCTION_LIMIT
                     && !check
                     && !is_pv
-                    && !MOVE_CAPTURE(move_list->moves[i]) 
-                    && !MOVE_PROMOTED(move_list->moves[i])
-                    && move_list->moves[i] != search->killer_moves[0][search->ply]
-                    && move_list->moves[i] != search->killer_moves[1][search->ply]) {
+                    && !MOVE_CAPTURE(move) 
+                    && !MOVE_PROMOTED(move)
+                    && move != search->killer_moves[0][search->ply]
+                    && move != search->killer_moves[1][search->ply]) {
 
                 int reduction = (moves_searched > 8) ? 3 : 2;
 
@@ -318,7 +450,7 @@ int negamax(int alpha, int beta, int depth, Search *search) {
         }
 
         search->ply--;
-        UNDO(board);
+        unmake_move(move, board);
 
          if (search->stopped) {
             return 0;
@@ -329,13 +461,14 @@ int negamax(int alpha, int beta, int depth, Search *search) {
         if (score > alpha) {
             hash_flag = flagEXACT; 
             // History Heuristic
-            if (MOVE_CAPTURE(move_list->moves[i]) == 0) {
-                search->history[MOVE_PIECE(move_list->moves[i])][MOVE_TARGET(move_list->moves[i])] += depth;
+            if (MOVE_CAPTURE(move) == 0) {
+                search->history[MOVE_PIECE(move)][MOVE_TARGET(move)] += depth;
             }
             alpha = score; // Found PV node
+            best_move = move;
 
             // Update PV line
-            search->pv_table[search->ply][search->ply] = move_list->moves[i];
+            search->pv_table[search->ply][search->ply] = move;
             for (int ply = search->ply + 1; ply < search->pv_length[search->ply + 1]; ply++) {
                 search->pv_table[search->ply][ply] = search->pv_table[search->ply + 1][ply];
             }
@@ -345,11 +478,11 @@ int negamax(int alpha, int beta, int depth, Search *search) {
         // Fail-hard beta-cutoff
         if (score >= beta) {
             beta_cutoff_count++;
-            record_hash(board, beta, depth, search->ply, flagBETA);
+            record_hash(board, beta, depth, search->ply, flagBETA, move);
             // Killer Heuristic
-            if (MOVE_CAPTURE(move_list->moves[i]) == 0) {
+            if (MOVE_CAPTURE(move) == 0) {
                 search->killer_moves[1][search->ply] = search->killer_moves[0][search->ply];
-                search->killer_moves[0][search->ply] = move_list->moves[i];
+                search->killer_moves[0][search->ply] = move;
             }
             return beta; // fails high
         }
@@ -366,7 +499,7 @@ int negamax(int alpha, int beta, int depth, Search *search) {
         return DRAW_SCORE;
     }
 
-    record_hash(board, alpha, depth, search->ply, hash_flag);
+    record_hash(board, alpha, depth, search->ply, hash_flag, best_move);
     return alpha; // fails low
 }
 
@@ -385,9 +518,7 @@ int quiescence(int alpha, int beta, Search *search) {
     Board *board = search->board;
 
     // Check for UCI input
-    if ((search->nodes & 2047) == 0) {
-        search->stopped = should_stop();
-    }
+    check_stop(search);
 
     search->nodes++;
 
@@ -398,7 +529,8 @@ int quiescence(int alpha, int beta, Search *search) {
     */
     int tempo = search->ply % 2 == 0 ? TEMPO_BONUS : -TEMPO_BONUS;
     
-    int score = evaluate(board) + tempo;
+    // The stand pat score only has to be compared to the window, so a clearly lost or won position is not fully evaluated
+    int score = evaluate_lazy(board, alpha - tempo, beta - tempo) + tempo;
     int stand_pat = score;
 
     // Too deep in the search
@@ -416,27 +548,17 @@ int quiescence(int alpha, int beta, Search *search) {
         return beta; // fails high cut-node
     }
 
-    Moves move_list[1];
-    generate_moves(move_list, board);
+    // Only the best move is taken from the hash table. Quiescence search does not use the stored scores,
+    // so it is left out of the hash hit rate.
+    int hash_move = expand_hash_move(probe_hash_move(board), board);
 
-    // Remove non-captures from move list
-    int capture_count = 0;
-    for (int i = 0; i < move_list->count; i++) {
-        if (MOVE_CAPTURE(move_list->moves[i])) {
-            if (i != capture_count) {
-                move_list->moves[capture_count] = move_list->moves[i];
-            }
-            capture_count++;
-        }
-    }
-    move_list->count = capture_count;
-    sort_moves(move_list, search);
+    MovePicker picker[1];
+    init_move_picker(picker, search, hash_move, 0, 1);
 
-    int opponent_material = get_material(!board->side);
-    for (int i = 0; i < move_list->count; i++) {
-        // Only search captures
-        if (!MOVE_CAPTURE(move_list->moves[i])) continue;
+    int opponent_material = get_material(board, !board->side);
+    int move;
 
+    while ((move = next_move(picker))) {
         /*
             Delta Cutoff
 
@@ -448,30 +570,8 @@ int quiescence(int alpha, int beta, Search *search) {
         */
 
         // Do not prune a capture on promotion. The position may be unstable.
-        if (!MOVE_PROMOTED(move_list->moves[i])) {
-            int captured_piece = -1;
-
-            if (MOVE_ENPASSANT(move_list->moves[i])) {
-                captured_piece = (board->side == WHITE) ? p : P;
-            } else {
-                int start = (board->side == WHITE) ? p : P;
-                int end = (board->side == WHITE) ? k : K;
-                int target = MOVE_TARGET(move_list->moves[i]);
-
-                for (int piece = start; piece <= end; piece++) {
-                    if (GET_BIT(board->bitboards[piece], target)) {
-                        captured_piece = piece;
-                        break;
-                    }
-                }
-            }
-
-            if (captured_piece == -1) {
-                printf("    [ERROR]: Captured piece not found\n");
-                continue;
-            }
-
-            int captured_piece_value = MATERIAL_SCORE[captured_piece % 6];
+        if (!MOVE_PROMOTED(move)) {
+            int captured_piece_value = MATERIAL_SCORE[MOVE_CAPTURED(move) % 6];
 
             // Do not prune captures in the endgame
             if (opponent_material - captured_piece_value > ENDGAME_MATERIAL_THRESHOLD) {
@@ -483,8 +583,8 @@ int quiescence(int alpha, int beta, Search *search) {
 
                 // Static Exchange Evaluation (SEE) - if a capture sequence loses material, prune the move.
                 // SEE is skipped for pawn captures as they do not lose material, so not worth the overhead of SEE. 
-                if (MOVE_PIECE(move_list->moves[i]) != (board->side == WHITE ? P : p)) {
-                    if (see(board, MOVE_TARGET(move_list->moves[i]), MOVE_SRC(move_list->moves[i])) < 0) {
+                if (MOVE_PIECE(move) != (board->side == WHITE ? P : p)) {
+                    if (see(board, MOVE_TARGET(move), MOVE_SRC(move)) < 0) {
                         see_prune++;
                         continue;
                     }
@@ -493,17 +593,13 @@ int quiescence(int alpha, int beta, Search *search) {
 
         }
 
-        COPY_BOARD(board);
         search->ply++;
 
-        if (make_move(move_list->moves[i], board) == 0) {
-            search->ply--;
-            continue;
-        }
+        make_move(move, board);
 
         int score = -quiescence(-beta, -alpha, search);
         search->ply--;
-        UNDO(board);
+        unmake_move(move, board);
 
         if (search->stopped) {
             return 0;
@@ -527,18 +623,18 @@ int see(Board *board, int target_square, int from_sq) {
     int side = board->side;
 
     // All pieces that can attack the target square
-    Bitboard attackers = get_attackers_to_square(target_square, side, board->occupancies, board->bitboards, board);
-    Bitboard defenders = get_attackers_to_square(target_square, side ^ 1, board->occupancies, board->bitboards, board);
+    Bitboard attackers = get_attackers_to_square(target_square, side, board->occupancies, board->bitboards);
+    Bitboard defenders = get_attackers_to_square(target_square, side ^ 1, board->occupancies, board->bitboards);
     Bitboard attacks_and_defends = attackers | defenders;
 
     // Gain array
     int gains[32], d = 0;
 
     // Initial gain from capture
-    gains[d] = MATERIAL_SCORE[get_piece_at_square(target_square, board->bitboards) % 6];
+    gains[d] = MATERIAL_SCORE[board->mailbox[target_square] % 6];
 
     int src = from_sq;
-    int piece = get_piece_at_square(src, board->bitboards);
+    int piece = board->mailbox[src];
 
     // Create copies of occupancy and bitboards
     Bitboard occupancies[3] = {board->occupancies[WHITE], board->occupancies[BLACK], board->occupancies[BOTH]};
@@ -547,18 +643,21 @@ int see(Board *board, int target_square, int from_sq) {
 
     do {
         // If the king can take, but there are other attackers, the king is not considered an attacker.
-        if (piece == (side == WHITE ? K : k) && get_attackers_to_square(target_square, !side, occupancies, bitboards, board)) {
+        if (piece == (side == WHITE ? K : k) && get_attackers_to_square(target_square, !side, occupancies, bitboards)) {
             POP_BIT(attacks_and_defends, src);
             POP_BIT(bitboards[piece], src);
             POP_BIT(occupancies[BOTH], src);
             POP_BIT(occupancies[side], src);
-            src = get_smallest_attacker(attacks_and_defends, side, bitboards);
-            piece = get_piece_at_square(src, bitboards);
+            src = get_smallest_attacker(attacks_and_defends, side, board);
+            if (src == -1) {
+                break;
+            }
+            piece = board->mailbox[src];
         }
 
         // Update pieces that can attack the target square to account for possible x-ray attacks
-        attackers = get_attackers_to_square(target_square, side, occupancies, bitboards, board);
-        defenders = get_attackers_to_square(target_square, side ^ 1, occupancies, bitboards, board);
+        attackers = get_attackers_to_square(target_square, side, occupancies, bitboards);
+        defenders = get_attackers_to_square(target_square, side ^ 1, occupancies, bitboards);
         attacks_and_defends = attackers | defenders;
 
         d++;
@@ -573,25 +672,29 @@ int see(Board *board, int target_square, int from_sq) {
         POP_BIT(occupancies[side], src);
 
         // Find the least valuable attacker to capture next
-        src = get_smallest_attacker(attacks_and_defends, side, bitboards);
-        piece = get_piece_at_square(src, bitboards);
+        src = get_smallest_attacker(attacks_and_defends, side, board);
+        if (src == -1) {
+            // The side to move has no piece left that can recapture
+            break;
+        }
+        piece = board->mailbox[src];
     } while (attacks_and_defends);
 
-    // Gain propagation
-    while (--d) {
+    // Gain propagation. The exchange can stop before any recapture when a king's capture is the only one and the square is defended.
+    while (d > 0 && --d) {
         gains[d - 1] = -MAX(-gains[d - 1], gains[d]);
     }
     return gains[0];
 }
 
 // Get the least valuable attacker to a square
-inline int get_smallest_attacker(Bitboard attackers, int side, Bitboard bitboards[]) {
+inline int get_smallest_attacker(Bitboard attackers, int side, Board *board) {
     int smallest_value = 12000;
     int smallest_square = -1;
 
     while (attackers) {
         int square = get_least_sig_bit_index(attackers);
-        int piece = get_piece_at_square(square, bitboards);
+        int piece = board->mailbox[square];
 
         // Make sure the piece is the correct color
         if ((side == BLACK && piece < p) || (side == WHITE && piece > K)) {
@@ -623,186 +726,3 @@ int is_repetition(Board* board) {
     }
     return 0;
 }
-
-/******** Most valuable victim/least valuable attacker (MVV-LVA) ********
- * When a less valuable piece captures a more valuable piece, 
- * the move should have priority in the search order (eg PxQ).
- * This helps hit the beta cutoff sooner, reducing the nodes searched. 
- *                           
- *  (Victim)    Pawn Knight Bishop   Rook  Queen   King
- *  (Attacker)
- *        Pawn   105    205    305    405    505    605
- *      Knight   104    204    304    404    504    604
- *      Bishop   103    203    303    403    503    603
- *        Rook   102    202    302    402    502    602
- *       Queen   101    201    301    401    501    601
- *        King   100    200    300    400    500    600
- *   
- ***********************************************************************/
-
-// MVV LVA [attacker][victim]
-static int mvv_lva[12][12] = {
- 	105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605,
-	104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604,
-	103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603,
-	102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602,
-	101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601,
-	100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600,
-
-	105, 205, 305, 405, 505, 605,  105, 205, 305, 405, 505, 605,
-	104, 204, 304, 404, 504, 604,  104, 204, 304, 404, 504, 604,
-	103, 203, 303, 403, 503, 603,  103, 203, 303, 403, 503, 603,
-	102, 202, 302, 402, 502, 602,  102, 202, 302, 402, 502, 602,
-	101, 201, 301, 401, 501, 601,  101, 201, 301, 401, 501, 601,
-	100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600
-};
-
-void pv_scoring(Moves *move_list, Search *search) {
-    search->follow_pv = 0;
-    for (int i = 0; i < move_list->count; i++) {
-        if (search->pv_table[0][search->ply] == move_list->moves[i]) {
-            search->score_pv = 1;
-            search->follow_pv = 1;
-        }
-    }
-}
-
-int score_move(int move, Search *search) {
-    if (search->score_pv) {
-        if (search->pv_table[0][search->ply] == move) {
-            search->score_pv = 0;
-            return 20000;
-        }
-    }
-
-    if (!MOVE_CAPTURE(move)) {
-        // Killer Heuristic
-        if (search->killer_moves[0][search->ply] == move) {
-            return BONUS_KILLER;
-        }
-
-        if (search->killer_moves[1][search->ply] == move) {
-            return BONUS_SECOND_KILLER;
-        }
-
-        // History Heuristic
-        return search->history[MOVE_PIECE(move)][MOVE_TARGET(move)];
-    }
-
-    int captured_piece = P;
-
-    int start = (search->board->side == WHITE) ? p : P;
-    int end = (search->board->side == WHITE) ? k : K;
-    int target = MOVE_TARGET(move);
-
-    for (int piece = start; piece <= end; piece++) {
-        if (GET_BIT(search->board->bitboards[piece], target)) {
-            captured_piece = piece;
-            break;
-        }
-    }
-    // MVV-LVA lookup
-    // 10,000 is added to ensure capture moves will score higher priority than quiet killer moves
-    // This is because captures have a higher change of producing a cutoff.
-    return mvv_lva[MOVE_PIECE(move)][captured_piece] + BONUS_CAPTURE;
-}
-
-void print_move_scores(Moves* move_list) {
-    printf("Move Scores:\n");
-    for (int i =0; i < move_list->count; i++) {
-        printf("Move: ");
-        print_move(move_list->moves[i]);
-        Search search = {0};
-        printf("  Score: %d\n", score_move(move_list->moves[i], &search));
-    }
-}
-
-static inline void insertion_sort(int *moves, int *scores, int low, int high) {
-    for (int i = low + 1; i <= high; i++) {
-        int key_score = scores[i];
-        int key_move = moves[i];
-        int j = i - 1;
-        while (j >= low && scores[j] < key_score) {
-            scores[j + 1] = scores[j];
-            moves[j + 1] = moves[j];
-            j--;
-        }
-        scores[j + 1] = key_score;
-        moves[j + 1] = key_move;
-    }
-}
-
-static inline int partition(int *moves, int *scores, int low, int high) {
-    int pivot = scores[high];
-    int i = low - 1;
-
-    for (int j = low; j < high; j++) {
-        if (scores[j] > pivot) {
-            i++;
-            // Swap scores
-            int temp_score = scores[i];
-            scores[i] = scores[j];
-            scores[j] = temp_score;
-
-            // Swap moves
-            int temp_move = moves[i];
-            moves[i] = moves[j];
-            moves[j] = temp_move;
-        }
-    }
-    // Swap scores
-    int temp_score = scores[i + 1];
-    scores[i + 1] = scores[high];
-    scores[high] = temp_score;
-
-    // Swap moves
-    int temp_move = moves[i + 1];
-    moves[i + 1] = moves[high];
-    moves[high] = temp_move;
-
-    return i + 1;
-}
-
-static inline void quick_sort_moves(int *moves, int *scores, int low, int high) {
-    while (low < high) {
-        if (high - low < INSERTION_SORT_THRESHOLD) {
-            insertion_sort(moves, scores, low, high);
-            break;
-        } else {
-            int pi = partition(moves, scores, low, high);
-            if (pi - low < high - pi) {
-                quick_sort_moves(moves, scores, low, pi - 1);
-                low = pi + 1;
-            } else {
-                quick_sort_moves(moves, scores, pi + 1, high);
-                high = pi - 1;
-            }
-        }
-    }
-}
-
-/**
- * 1. PV move
- * 2. Captures with MVV/LVA
- * 3. Killer Heuristic
- * 4. History Heuristic
- * 5. Remaining moves
- */
-int sort_moves(Moves *move_list, Search *search) {
-    int count = move_list->count;
-    int *scores = (int *)malloc(count * sizeof(int));
-
-    if (scores == NULL) {
-        fprintf(stderr, "Memory allocation failed\n");
-        return -1;
-    }
-
-    for (int i = 0; i < count; i++) {
-        scores[i] = score_move(move_list->moves[i], search);
-    }
-
-    quick_sort_moves(move_list->moves, scores, 0, count - 1);
-
-    free(scores);
-    return 0;
-}
\ No newline at end of file
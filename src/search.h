@@ -4,6 +4,8 @@
 #include "move.h"
 #include "bitboard.h"
 
+#define BONUS_HASH_MOVE 30000
+#define BONUS_PV_MOVE 20000
 #define BONUS_KILLER 9000
 #define BONUS_SECOND_KILLER 8000
 #define BONUS_CAPTURE 10000
@@ -19,28 +21,29 @@
 #define FUTILITY_MARGIN 200
 #define RAZOR_MARGIN 100
 #define TEMPO_BONUS 10
+#define MAX_THREADS 64
 
 typedef struct {
     unsigned long long nodes;
     Board *board;
     int ply;
     int follow_pv;
-    int score_pv;
     int stopped;
+    int thread_id; // 0 for the main thread, helper threads are numbered from 1
     int pv_length[MAX_PLY];
     int killer_moves[2][MAX_PLY]; 
     int history[12][64]; // [piece][square]
     int pv_table[MAX_PLY][MAX_PLY];
 } Search;
 
+extern int thread_count;
+extern unsigned long long last_search_nodes;
+
 int search(int, Board*);
 int negamax(int, int, int, Search*);
 int quiescence(int, int, Search*);
-void print_move_scores(Moves*);
-int sort_moves(Moves*, Search*);
-void pv_scoring(Moves*, Search*);
 int is_repetition(Board*);
 int see(Board*, int, int);
-int get_smallest_attacker(Bitboard, int, Bitboard[]);
+int get_smallest_attacker(Bitboard, int, Board*);
 
 #endif
@@ -2,30 +2,75 @@
 #include <stddef.h>
 
 #include "table.h"
-#include "magics.h"
+#include "move.h"
+#include "search.h"
 
+#ifdef USE_GENERATED_TABLES
+#include "generated_keys.h"
+#else
 Bitboard piece_keys[12][64];
 Bitboard enpassant_keys[64];
 Bitboard castling_keys[16];
 Bitboard side_key;
+#endif
 
-int hash_entries = 0;
-TranspositionTable *transposition_table = NULL; 
+int hash_clusters = 0;
+int hash_shift = 64;
+int hash_generation = 0;
+
+// Probe statistics for the hash hit rate. Kept per thread like the search statistics.
+_Thread_local unsigned long long tt_probes, tt_hits;
+HashCluster *transposition_table = NULL; 
+void *transposition_memory = NULL;
+
+// One pawn table per search thread, indexed by thread id. Tables are allocated the first time a thread searches.
+static PawnTable pawn_tables[MAX_THREADS];
+int pawn_hash_size = DEFAULT_PAWN_HASH;
+
+Bitboard *eval_cache = NULL;
+Bitboard eval_cache_mask = 0;
+int eval_cache_size = DEFAULT_EVAL_CACHE;
+_Thread_local unsigned long long eval_probes, eval_hits;
+
+// The pawn table of the current thread, or NULL outside of a search
+_Thread_local PawnTable *pawn_table = NULL;
+_Thread_local unsigned long long pawn_probes, pawn_hits;
+
+// Material tables are kept like the pawn tables, with a fixed size
+static MaterialTable material_tables[MAX_THREADS];
+_Thread_local MaterialTable *material_table = NULL;
+
+#ifndef USE_GENERATED_TABLES
+/*
+ SplitMix64 with a fixed seed, so the keys are the same on every run.
+ The xorshift generator used for the magic numbers is linear, so its outputs satisfy short XOR relations.
+ Zobrist keys combine by XOR, and those relations made different positions hash to the same key far more often than chance.
+ Reference: https://prng.di.unimi.it/splitmix64.c
+*/
+static Bitboard key_state = 0x9e3779b97f4a7c15ULL;
+
+static Bitboard generate_hash_key_number() {
+    Bitboard z = (key_state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
 
 void init_hash_keys() {
     for (int piece = P; piece <= k; piece++) {
         for (int square = 0; square < 64; square++) {
-            piece_keys[piece][square] = generate_random_U64_number();
+            piece_keys[piece][square] = generate_hash_key_number();
         }
     }
     for (int square = 0; square < 64; square++) {
-        enpassant_keys[square] = generate_random_U64_number();
+        enpassant_keys[square] = generate_hash_key_number();
     }
     for (int i = 0; i < 16; i++) {
-        castling_keys[i] = generate_random_U64_number();
+        castling_keys[i] = generate_hash_key_number();
     }   
-    side_key = generate_random_U64_number();
+    side_key = generate_hash_key_number();
 }
+#endif
 
 void init_hash_table(int mb) {
     if (mb <= 0) {
@@ -33,22 +78,32 @@ void init_hash_table(int mb) {
         mb = 64;
     }
 
-    int hash_size = 0x100000 * mb;
-    hash_entries = hash_size / sizeof(TranspositionTable);
+    // Use the largest power of two number of clusters that fits in the given memory.
+    // The cluster index is then just the top bits of the hash key.
+    Bitboard hash_size = 0x100000ULL * mb;
+    int bits = 0;
+    while ((sizeof(HashCluster) << (bits + 1)) <= hash_size) {
+        bits++;
+    }
+    hash_clusters = 1 << bits;
+    hash_shift = 64 - bits;
 
-    if (transposition_table != NULL) {
-        free(transposition_table);
+    if (transposition_memory != NULL) {
+        free(transposition_memory);
     }
 
-    transposition_table = (TranspositionTable *) malloc(hash_entries * sizeof(TranspositionTable));
+    // Allocate an extra cache line so the clusters can be aligned to cache lines.
+    // calloc returns zeroed memory, which for a table this size the OS maps in lazily instead of the table being cleared here.
+    transposition_memory = calloc(1, hash_clusters * sizeof(HashCluster) + 64);
     
-    if (transposition_table == NULL) {
+    if (transposition_memory == NULL) {
         printf("    [ERROR] Error allocating hash table with %dMB!\n", mb);
         init_hash_table(mb / 2);
         return;
     }
-    clear_transposition_table();
-    printf("    [DEBUG] Hash table allocated with %dMB and %d entries\n", mb, hash_entries);
+    transposition_table = (HashCluster *)(((uintptr_t)transposition_memory + 63) & ~(uintptr_t)63);
+    hash_generation = 0;
+    printf("    [DEBUG] Hash table allocated with %dMB and %d entries\n", mb, hash_clusters * CLUSTER_SIZE);
 }
 
 Bitboard generate_hash_key(Board* board) {
@@ -80,45 +135,219 @@ Bitboard generate_hash_key(Board* board) {
     return key;
 }
 
-void clear_transposition_table() {
-    memset(transposition_table, 0, hash_entries * sizeof(TranspositionTable));
-}
+// A size of 0 disables the cache
+void init_eval_cache(int mb) {
+    free(eval_cache);
+    eval_cache = NULL;
+    eval_cache_size = mb;
+    if (mb <= 0) {
+        return;
+    }
 
-void record_hash(Board* board, int score, int depth, int ply, int flag) {
-    if (score < -MATE_SCORE) score -= ply;
-    if (score > MATE_SCORE) score += ply;
-    TranspositionTable *entry = &transposition_table[board->hash_key % hash_entries];
-    entry->key = board->hash_key;
-    entry->score = score;
-    entry->flag = flag;
-    entry->depth = depth; 
+    Bitboard count = 1;
+    while (sizeof(Bitboard) * count * 2 <= 0x100000ULL * mb) {
+        count *= 2;
+    }
+    eval_cache = calloc(count, sizeof(Bitboard));
+    if (eval_cache == NULL) {
+        printf("    [ERROR] Error allocating evaluation cache with %dMB!\n", mb);
+        return;
+    }
+    eval_cache_mask = count - 1;
 }
 
-int probe_hash(Board* board, int alpha, int beta, int depth, int ply) {
-    TranspositionTable *entry = &transposition_table[board->hash_key % hash_entries];
+Bitboard generate_pawn_key(Board* board) {
+    Bitboard key = 0ULL;
+    for (int piece = P; piece <= p; piece += p) {
+        Bitboard bitboard = board->bitboards[piece];
+        while (bitboard) {
+            int square = get_least_sig_bit_index(bitboard);
+            key ^= piece_keys[piece][square];
+            POP_BIT(bitboard, square);
+        }
+    }
+    return key;
+}
 
-    if (entry->key != board->hash_key) {
-        return valueUNKNOWN;
+// Frees the pawn tables. Each thread allocates a table of the new size the next time it searches.
+void set_pawn_hash_size(int mb) {
+    pawn_hash_size = mb;
+    for (int i = 0; i < MAX_THREADS; i++) {
+        free(pawn_tables[i].entries);
+        pawn_tables[i].entries = NULL;
     }
+}
 
-    if (entry->depth < depth) {
-        return valueUNKNOWN;
+// Called by each search thread before it searches
+void select_pawn_table(int thread_id) {
+    PawnTable *table = &pawn_tables[thread_id];
+    if (table->entries == NULL) {
+        int count = 1;
+        while (sizeof(PawnEntry) * count * 2 <= 0x100000ULL * pawn_hash_size) {
+            count *= 2;
+        }
+        table->entries = malloc(count * sizeof(PawnEntry));
+        if (table->entries == NULL) {
+            printf("    [ERROR] Error allocating pawn hash table with %dMB!\n", pawn_hash_size);
+            pawn_table = NULL;
+            return;
+        }
+        table->mask = count - 1;
+
+        // Empty entries hold the structure of a position without pawns, whose key is 0
+        for (int i = 0; i < count; i++) {
+            table->entries[i] = (PawnEntry){ .key = 0ULL, .semi_open = { ~0ULL, ~0ULL } };
+        }
     }
+    pawn_table = table;
+}
 
-    int score = entry->score;
-    if (score < -MATE_SCORE) score += ply;
-    if (score > MATE_SCORE) score -= ply;
+// Returns the entry for the board's pawns. The caller fills it in if its key does not match.
+PawnEntry *get_pawn_entry(Board *board) {
+    pawn_probes++;
+    return &pawn_table->entries[board->pawn_key & pawn_table->mask];
+}
 
-    if (entry->flag == flagEXACT) {
-        return score;
+/**
+ * The material key has one key per piece and count: piece_keys[piece][n] is included when there are more than n of the piece.
+ * Adding or removing a piece then changes the key by the single key of the count it reached or left.
+ */
+Bitboard generate_material_key(Board *board) {
+    Bitboard key = 0ULL;
+    for (int piece = P; piece <= k; piece++) {
+        int count = count_bits(board->bitboards[piece]);
+        for (int n = 0; n < count; n++) {
+            key ^= piece_keys[piece][n];
+        }
     }
-    if ((entry->flag == flagALPHA) && (score <=alpha)) {
-        return alpha;
+    return key;
+}
+
+// Called by each search thread before it searches
+void select_material_table(int thread_id) {
+    MaterialTable *table = &material_tables[thread_id];
+    if (table->entries == NULL) {
+        table->entries = calloc(MATERIAL_TABLE_SIZE, sizeof(MaterialEntry));
+        if (table->entries == NULL) {
+            printf("    [ERROR] Error allocating material table!\n");
+            material_table = NULL;
+            return;
+        }
+    }
+    material_table = table;
+}
+
+// Returns the entry for the board's material. The caller fills it in if its key does not match.
+MaterialEntry *get_material_entry(Board *board) {
+    return &material_table->entries[board->material_key & (MATERIAL_TABLE_SIZE - 1)];
+}
+
+void clear_transposition_table() {
+    memset(transposition_table, 0, hash_clusters * sizeof(HashCluster));
+    hash_generation = 0;
+}
+
+// Called once per search so entries from previous searches age and are replaced first.
+void increment_hash_generation() {
+    hash_generation = (hash_generation + 1) % MAX_HASH_GENERATION;
+}
+
+static inline HashCluster *get_cluster(Bitboard hash_key) {
+    // hash_shift is 64 when there is a single cluster, which would be undefined for a shift
+    return &transposition_table[hash_clusters > 1 ? hash_key >> hash_shift : 0];
+}
+
+// How many searches ago the entry was stored
+static inline int hash_age(Bitboard entry) {
+    return (hash_generation - HASH_GENERATION(entry) + MAX_HASH_GENERATION) % MAX_HASH_GENERATION;
+}
+
+// The best move is stored in its compact form. A move of 0 keeps the move already stored for the position.
+void record_hash(Board* board, int score, int depth, int ply, int flag, int best_move) {
+    if (score < -MATE_SCORE) score -= ply;
+    if (score > MATE_SCORE) score += ply;
+    if (depth < 0) depth = 0;
+    if (depth > MAX_HASH_DEPTH) depth = MAX_HASH_DEPTH;
+
+    HashCluster *cluster = get_cluster(board->hash_key);
+    Bitboard key = HASH_KEY_BITS(board->hash_key);
+
+    // Replace the entry for the same position if there is one.
+    // Otherwise replace the entry with the least value, weighing depth against age.
+    // Empty entries have no value, and every search an entry ages costs it the value of a few plies. 
+    int move = COMPACT_MOVE(best_move);
+    int replace = 0;
+    int lowest_value = INT_MAX;
+    for (int i = 0; i < CLUSTER_SIZE; i++) {
+        Bitboard entry = __atomic_load_n(&cluster->entries[i], __ATOMIC_RELAXED);
+        if (HASH_KEY_BITS(entry) == key && entry) {
+            if (!move) {
+                move = HASH_MOVE(entry);
+            }
+            replace = i;
+            break;
+        }
+        int value = entry ? HASH_DEPTH(entry) - 4 * hash_age(entry) : INT_MIN;
+        if (value < lowest_value) {
+            lowest_value = value;
+            replace = i;
+        }
     }
-    if ((entry->flag == flagBETA) && (score >= beta)) {
-        return beta;
+
+    // Relaxed atomic stores only prevent the compiler from splitting the write.
+    Bitboard entry = PACK_HASH_ENTRY(key, score, depth, flag, hash_generation, move);
+    __atomic_store_n(&cluster->entries[replace], entry, __ATOMIC_RELAXED);
+}
+
+// The compact best move of the position is written to hash_move even when the score cannot be used.
+int probe_hash(Board* board, int alpha, int beta, int depth, int ply, int *hash_move) {
+    HashCluster *cluster = get_cluster(board->hash_key);
+    Bitboard key = HASH_KEY_BITS(board->hash_key);
+    tt_probes++;
+    *hash_move = 0;
+
+    for (int i = 0; i < CLUSTER_SIZE; i++) {
+        Bitboard entry = __atomic_load_n(&cluster->entries[i], __ATOMIC_RELAXED);
+        if (HASH_KEY_BITS(entry) != key || !entry) {
+            continue;
+        }
+        tt_hits++;
+        *hash_move = HASH_MOVE(entry);
+
+        if (HASH_DEPTH(entry) < depth) {
+            return valueUNKNOWN;
+        }
+
+        int score = HASH_SCORE(entry);
+        if (score < -MATE_SCORE) score += ply;
+        if (score > MATE_SCORE) score -= ply;
+
+        int flag = HASH_FLAG(entry);
+        if (flag == flagEXACT) {
+            return score;
+        }
+        if ((flag == flagALPHA) && (score <= alpha)) {
+            return alpha;
+        }
+        if ((flag == flagBETA) && (score >= beta)) {
+            return beta;
+        }
+        return valueUNKNOWN;
     }
 
     return valueUNKNOWN;
+}
+
+// Returns the compact best move stored for the position, or 0. Not counted in the probe statistics.
+int probe_hash_move(Board* board) {
+    HashCluster *cluster = get_cluster(board->hash_key);
+    Bitboard key = HASH_KEY_BITS(board->hash_key);
 
-}
\ No newline at end of file
+    for (int i = 0; i < CLUSTER_SIZE; i++) {
+        Bitboard entry = __atomic_load_n(&cluster->entries[i], __ATOMIC_RELAXED);
+        if (HASH_KEY_BITS(entry) == key && entry) {
+            return HASH_MOVE(entry);
+        }
+    }
+    return 0;
+}
@@ -1,3 +1,6 @@
+#ifndef TABLE_H
+#define TABLE_H
+
 #include <stdlib.h>
 #include <limits.h>
 
@@ -12,21 +15,145 @@
 #define MATE_VALUE 50000
 #define MATE_SCORE 49000
 
+/**
+ * The transposition table is made of clusters of entries, each cluster filling exactly one 64-byte cache line.
+ * A position is mapped to a single cluster, and any of the entries in that cluster can hold it. 
+ * This keeps a probe to a single cache miss while letting deep entries survive stores from shallow searches.
+ * 
+ * Each entry is a single 64-bit word, so entries are read and written without locks by the search threads.
+ * A single aligned 64-bit access cannot be torn, so an entry always holds the data from exactly one write.
+ * Only 16 bits of the hash key are stored in the entry. The cluster index comes from the top bits of the key,
+ * so the fragment and the index together verify the position.
+ * Reference: https://www.chessprogramming.org/Transposition_Table#Bucket_Systems
+ */
+#define CLUSTER_SIZE 8
+
+typedef struct {
+    Bitboard entries[CLUSTER_SIZE];
+} HashCluster;
+
+// Entry layout: key fragment in bits 0-15, score in bits 16-32, depth in bits 33-39, flag in bits 40-41, generation in bits 42-47,
+// and the compact best move in bits 48-63
+#define HASH_KEY_BITS(key) ((key) & 0xffffULL)
+#define PACK_HASH_ENTRY(key, score, depth, flag, generation, move) \
+    (HASH_KEY_BITS(key) | ((Bitboard)((score) & 0x1ffff) << 16) | ((Bitboard)(depth) << 33) | ((Bitboard)(flag) << 40) | ((Bitboard)(generation) << 42) | ((Bitboard)(move) << 48))
+#define HASH_SCORE(entry) ((int)((((entry) >> 16) & 0x1ffff) ^ 0x10000) - 0x10000)
+#define HASH_DEPTH(entry) ((int)(((entry) >> 33) & 0x7f))
+#define HASH_FLAG(entry) ((int)(((entry) >> 40) & 0x3))
+#define HASH_GENERATION(entry) ((int)(((entry) >> 42) & 0x3f))
+#define HASH_MOVE(entry) ((int)(((entry) >> 48) & 0xffff))
+
+#define MAX_HASH_DEPTH 0x7f
+#define MAX_HASH_GENERATION 0x40
+
+/**
+ * Pawn hash table
+ * The pawn structure terms only depend on the pawns, which rarely change between neighbouring nodes.
+ * They are cached by the pawn hash key, the Zobrist key of the pawns alone, kept up to date by make_move().
+ * Each search thread has its own table, so entries need no locking.
+ */
 typedef struct {
     Bitboard key;
-    int16_t depth;
-    int8_t flag;
-    int32_t score;
-} TranspositionTable;
+    Bitboard passed[2]; // Passed pawns of each side
+    Bitboard semi_open[2]; // Squares on files without a pawn of the side
+    int score[2]; // Pawn structure score of each side
+} PawnEntry;
+
+typedef struct {
+    PawnEntry *entries;
+    int mask;
+} PawnTable;
 
+/**
+ * Material table
+ * Everything that depends only on how many pieces of each kind are on the board is cached by the material key,
+ * the Zobrist key of the piece counts: the imbalance terms, how drawish the material is,
+ * and the specialized evaluator for endgames that have one. Like the pawn tables there is one table per search thread.
+ */
+typedef struct {
+    Bitboard key;
+    int imbalance[2]; // Piece values adjusted for the side's own pawns, and piece pair bonuses
+    int scale[2]; // Halves of the score kept when the side is ahead: 2 normally, 1 when drawish and 0 when it cannot win
+    int strong_side; // The side the endgame evaluator is called for
+    int (*endgame)(Board*, int); // Specialized endgame evaluator, or NULL
+} MaterialEntry;
+
+typedef struct {
+    MaterialEntry *entries;
+} MaterialTable;
+
+#define MATERIAL_TABLE_SIZE 8192 // Entries per thread, a power of 2
+
+#define DEFAULT_PAWN_HASH 2 // MB per thread
+#define MIN_PAWN_HASH 1
+#define MAX_PAWN_HASH 64
+
+/**
+ * Evaluation cache
+ * Static evaluations are cached by hash key so transpositions and re-searches do not evaluate the same position again.
+ * Like the transposition table, each entry is a single 64-bit word shared by all threads without locks:
+ * the top 48 bits of the hash key verify the position and the low 16 bits hold the score.
+ * Entries are read and written with relaxed atomic accesses, so the compiler never splits or re-reads one.
+ */
+#define DEFAULT_EVAL_CACHE 8 // MB
+#define MIN_EVAL_CACHE 0 // Disables the cache
+#define MAX_EVAL_CACHE 256
+#define EVAL_CACHE_KEY(key) ((key) & ~0xffffULL)
+
+#ifndef USE_GENERATED_TABLES
 void init_hash_keys();
+#endif
+void init_eval_cache(int);
+void set_pawn_hash_size(int);
+void select_pawn_table(int);
+PawnEntry *get_pawn_entry(Board*);
+Bitboard generate_pawn_key(Board*);
+void select_material_table(int);
+MaterialEntry *get_material_entry(Board*);
+Bitboard generate_material_key(Board*);
 void init_hash_table(int);
 Bitboard generate_hash_key(Board*);
 void clear_transposition_table();
-void record_hash(Board*, int, int, int, int);
-int probe_hash(Board*, int, int, int, int);
+void increment_hash_generation();
+void record_hash(Board*, int, int, int, int, int);
+int probe_hash(Board*, int, int, int, int, int*);
+int probe_hash_move(Board*);
+
+extern TABLE_CONST Bitboard piece_keys[12][64];
+extern TABLE_CONST Bitboard enpassant_keys[64];
+extern TABLE_CONST Bitboard castling_keys[16];
+extern TABLE_CONST Bitboard side_key;
+extern _Thread_local unsigned long long tt_probes, tt_hits;
+extern _Thread_local unsigned long long pawn_probes, pawn_hits;
+extern _Thread_local PawnTable *pawn_table;
+extern _Thread_local MaterialTable *material_table;
+extern int hash_clusters;
+extern int pawn_hash_size;
+extern Bitboard *eval_cache;
+extern Bitboard eval_cache_mask;
+extern int eval_cache_size;
+extern _Thread_local unsigned long long eval_probes, eval_hits;
+
+// Returns 1 and sets score if the position's evaluation is cached
+static inline int probe_eval_cache(Bitboard hash_key, int *score) {
+    if (eval_cache == NULL) {
+        return 0;
+    }
+    eval_probes++;
+    Bitboard entry = __atomic_load_n(&eval_cache[hash_key & eval_cache_mask], __ATOMIC_RELAXED);
+    if (EVAL_CACHE_KEY(entry) != EVAL_CACHE_KEY(hash_key)) {
+        return 0;
+    }
+    eval_hits++;
+    *score = (int16_t)(entry & 0xffff);
+    return 1;
+}
+
+static inline void store_eval_cache(Bitboard hash_key, int score) {
+    if (eval_cache == NULL || score < INT16_MIN || score > INT16_MAX) {
+        return;
+    }
+    __atomic_store_n(&eval_cache[hash_key & eval_cache_mask], EVAL_CACHE_KEY(hash_key) | (uint16_t)score, __ATOMIC_RELAXED);
+}
 
-extern Bitboard piece_keys[12][64];
-extern Bitboard enpassant_keys[64];
-extern Bitboard castling_keys[16];
-extern Bitboard side_key;
\ No newline at end of file
+#endif
@@ -1,10 +1,18 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 #include "tests.h"
 #include "bitboard.h"
 #include "search.h"
 #include "board.h"
+#include "table.h"
+#include "move.h"
+#include "eval.h"
+#include "endgame.h"
+#include "nnue.h"
+#include "magics.h"
 
 typedef struct {
     char* fen;
@@ -69,31 +77,31 @@ typedef struct {
 
 CheckTest check_tests[NUM_CHECK_TESTS] = {
     // Disovered Check
-    {"7k/8/8/4K3/8/8/4b3/4r3 b - - 0 1", encode_move(52, 43, b, 0, 0, 0, 0, 0), 1},
-    {"7k/8/8/4K3/8/8/4b3/4r3 b - - 0 1", encode_move(60, 61, r, 0, 0, 0, 0, 0), 0},
-    {"7k/1b6/2r5/8/4K3/8/8/8 b - - 0 1", encode_move(18, 16, r, 0, 0, 0, 0, 0), 1},
-    {"7k/1b6/2r5/8/4K3/8/8/8 b - - 0 1", encode_move(9, 0, b, 0, 0, 0, 0, 0), 0},
-    {"1Q6/2N4K/8/4k3/8/8/8/8 w - - 0 1", encode_move(10, 0, N, 0, 0, 0, 0, 0), 1},
-    {"1Q6/2N4K/3N4/4k3/8/8/8/8 w - - 0 1", encode_move(10, 0, N, 0, 0, 0, 0, 0), 0},
-    {"1B6/2Q4K/3N4/4k3/8/8/8/8 w - - 0 1", encode_move(19, 2, N, 0, 0, 0, 0, 0), 1},
+    {"7k/8/8/4K3/8/8/4b3/4r3 b - - 0 1", encode_move(52, 43, b, 0, 0, 0, 0, 0, 0), 1},
+    {"7k/8/8/4K3/8/8/4b3/4r3 b - - 0 1", encode_move(60, 61, r, 0, 0, 0, 0, 0, 0), 0},
+    {"7k/1b6/2r5/8/4K3/8/8/8 b - - 0 1", encode_move(18, 16, r, 0, 0, 0, 0, 0, 0), 1},
+    {"7k/1b6/2r5/8/4K3/8/8/8 b - - 0 1", encode_move(9, 0, b, 0, 0, 0, 0, 0, 0), 0},
+    {"1Q6/2N4K/8/4k3/8/8/8/8 w - - 0 1", encode_move(10, 0, N, 0, 0, 0, 0, 0, 0), 1},
+    {"1Q6/2N4K/3N4/4k3/8/8/8/8 w - - 0 1", encode_move(10, 0, N, 0, 0, 0, 0, 0, 0), 0},
+    {"1B6/2Q4K/3N4/4k3/8/8/8/8 w - - 0 1", encode_move(19, 2, N, 0, 0, 0, 0, 0, 0), 1},
     // Basic Checks
-    {"8/2k5/8/4K3/5B2/8/8/8 w - - 0 1", encode_move(28, 35, K, 0, 0, 0, 0, 0), 1},
-    {"8/B7/3k1K2/8/8/8/8/8 w - - 0 1", encode_move(8, 1, B, 0, 0, 0, 0, 0), 1},
-    {"8/Q7/3k1K2/8/8/8/8/8 w - - 0 1", encode_move(8, 1, Q, 0, 0, 0, 0, 0), 1},
-    {"R7/8/3k1K2/8/8/8/8/8 w - - 0 1", encode_move(0, 3, R, 0, 0, 0, 0, 0), 1},
-    {"3N4/8/3k1K2/8/8/8/8/8 w - - 0 1", encode_move(3, 9, N, 0, 0, 0, 0, 0), 1},
-    {"3N4/8/3k1K2/8/8/8/8/8 w - - 0 1", encode_move(3, 13, N, 0, 0, 0, 0, 0), 1},
-    {"3N4/8/3k1K2/8/8/8/8/8 w - - 0 1", encode_move(3, 20, N, 0, 0, 0, 0, 0), 0},
+    {"8/2k5/8/4K3/5B2/8/8/8 w - - 0 1", encode_move(28, 35, K, 0, 0, 0, 0, 0, 0), 1},
+    {"8/B7/3k1K2/8/8/8/8/8 w - - 0 1", encode_move(8, 1, B, 0, 0, 0, 0, 0, 0), 1},
+    {"8/Q7/3k1K2/8/8/8/8/8 w - - 0 1", encode_move(8, 1, Q, 0, 0, 0, 0, 0, 0), 1},
+    {"R7/8/3k1K2/8/8/8/8/8 w - - 0 1", encode_move(0, 3, R, 0, 0, 0, 0, 0, 0), 1},
+    {"3N4/8/3k1K2/8/8/8/8/8 w - - 0 1", encode_move(3, 9, N, 0, 0, 0, 0, 0, 0), 1},
+    {"3N4/8/3k1K2/8/8/8/8/8 w - - 0 1", encode_move(3, 13, N, 0, 0, 0, 0, 0, 0), 1},
+    {"3N4/8/3k1K2/8/8/8/8/8 w - - 0 1", encode_move(3, 20, N, 0, 0, 0, 0, 0, 0), 0},
     // Pawn Checks
-    {"2k5/8/1P3K2/8/8/8/8/8 w - - 0 1", encode_move(17, 9, P, 0, 0, 0, 0, 0), 1},
-    {"1k6/8/1P3K2/8/8/8/8/8 w - - 0 1", encode_move(17, 9, P, 0, 0, 0, 0, 0), 0},
-    {"8/8/5K2/8/1k6/8/P7/8 w - - 0 1", encode_move(48, 32, P, 0, 0, 0, 0, 0), 0},
-    {"8/8/5K2/1k6/8/8/P7/8 w - - 0 1", encode_move(48, 32, P, 0, 0, 0, 0, 0), 1},
+    {"2k5/8/1P3K2/8/8/8/8/8 w - - 0 1", encode_move(17, 9, P, 0, 0, 0, 0, 0, 0), 1},
+    {"1k6/8/1P3K2/8/8/8/8/8 w - - 0 1", encode_move(17, 9, P, 0, 0, 0, 0, 0, 0), 0},
+    {"8/8/5K2/8/1k6/8/P7/8 w - - 0 1", encode_move(48, 32, P, 0, 0, 0, 0, 0, 0), 0},
+    {"8/8/5K2/1k6/8/8/P7/8 w - - 0 1", encode_move(48, 32, P, 0, 0, 0, 0, 0, 0), 1},
     // En passant checks
-    {"8/1k6/5K2/2pP4/8/8/8/8 w - c6 0 2", encode_move(27, 18, P, 0, 0, 0, 1, 0), 1},
-    {"3k4/8/5K2/2pP4/8/8/8/3R4 w - c6 0 2", encode_move(27, 18, P, 0, 0, 0, 1, 0), 1},
-    {"3k4/8/5K2/2pP4/8/8/8/3Q4 w - c6 0 2", encode_move(27, 18, P, 0, 0, 0, 1, 0), 1},
-    {"6k1/8/5K2/2pP4/8/8/B7/8 w - c6 0 2", encode_move(27, 18, P, 0, 0, 0, 1, 0), 1},
+    {"8/1k6/5K2/2pP4/8/8/8/8 w - c6 0 2", encode_move(27, 18, P, 0, 0, 0, 0, 1, 0), 1},
+    {"3k4/8/5K2/2pP4/8/8/8/3R4 w - c6 0 2", encode_move(27, 18, P, 0, 0, 0, 0, 1, 0), 1},
+    {"3k4/8/5K2/2pP4/8/8/8/3Q4 w - c6 0 2", encode_move(27, 18, P, 0, 0, 0, 0, 1, 0), 1},
+    {"6k1/8/5K2/2pP4/8/8/B7/8 w - c6 0 2", encode_move(27, 18, P, 0, 0, 0, 0, 1, 0), 1},
 };
 
 int test_gives_check() {
@@ -115,6 +123,782 @@ int test_gives_check() {
     return 1;
 }
 
+#define TT_TEST_THREADS 8
+#define TT_TEST_ITERATIONS 500000
+#define TT_TEST_CLUSTERS 4
+#define TT_TEST_KEYS 48
+
+// The score stored for a key is derived from the key bits the table verifies, 
+// so any entry mixed from two writes can be detected.
+static int tt_test_score(Bitboard key) {
+    return (int)(key & 0xffff) - 0x8000;
+}
+
+// All threads draw their keys from this small set, so probes read entries that other threads are writing.
+// There are more keys per cluster than entries, so entries are also constantly replaced.
+static Bitboard tt_test_keys[TT_TEST_KEYS];
+
+typedef struct {
+    unsigned int seed;
+    int failures;
+    int hits;
+} TTStressThread;
+
+static void *tt_stress_worker(void *arg) {
+    TTStressThread *thread = (TTStressThread *)arg;
+    Board board;
+    unsigned int seed = thread->seed;
+
+    for (int i = 0; i < TT_TEST_ITERATIONS; i++) {
+        // XOR shift 32 algorithm
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+
+        board.hash_key = tt_test_keys[seed % TT_TEST_KEYS];
+
+        if (i & 1) {
+            record_hash(&board, tt_test_score(board.hash_key), seed % 64, 0, flagEXACT, 0);
+        } else {
+            int hash_move;
+            int score = probe_hash(&board, -MATE_VALUE, MATE_VALUE, 0, 0, &hash_move);
+            if (score == valueUNKNOWN) {
+                continue;
+            }
+            thread->hits++;
+            if (score != tt_test_score(board.hash_key)) {
+                thread->failures++;
+            }
+        }
+    }
+    return NULL;
+}
+
+int test_transposition_table() {
+    pthread_t threads[TT_TEST_THREADS];
+    TTStressThread workers[TT_TEST_THREADS] = {0};
+
+    // The test needs a table with only a few clusters. The current size is restored afterwards.
+    int previous_mb = (int)(hash_clusters * sizeof(HashCluster) / 0x100000ULL);
+    init_hash_table(4);
+
+    // Keys spread over the first clusters with distinct, nonzero verification bits
+    for (int i = 0; i < TT_TEST_KEYS; i++) {
+        tt_test_keys[i] = ((Bitboard)(i % TT_TEST_CLUSTERS) << 62) | (((Bitboard)(i + 1) * 0x9e37) & 0xffff);
+    }
+
+    for (int i = 0; i < TT_TEST_THREADS; i++) {
+        workers[i].seed = 0x9e3779b9u * (i + 1);
+        pthread_create(&threads[i], NULL, tt_stress_worker, &workers[i]);
+    }
+
+    int total_failures = 0, total_hits = 0;
+    for (int i = 0; i < TT_TEST_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        total_failures += workers[i].failures;
+        total_hits += workers[i].hits;
+    }
+    init_hash_table(previous_mb > 0 ? previous_mb : 64);
+
+    if (total_failures) {
+        printf("FAILURE testing transposition table: %d corrupted scores returned\n", total_failures);
+        return 0;
+    }
+    if (total_hits == 0) {
+        printf("FAILURE testing transposition table: no probe found a stored entry\n");
+        return 0;
+    }
+    printf("Transposition table tests passed\n");
+    return 1;
+}
+
+static char *hash_move_fens[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R b KQkq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "8/1k6/5K2/2pP4/8/8/8/8 w - c6 0 2",
+};
+
+// Every generated move must survive the round trip through the hash table,
+// and every compact move accepted by expand_hash_move() must be a generated move.
+int test_hash_move() {
+    Board* board = create_board();
+    int positions = sizeof(hash_move_fens) / sizeof(hash_move_fens[0]);
+
+    for (int i = 0; i < positions; i++) {
+        load_fen(hash_move_fens[i], board);
+        Moves move_list[1];
+        generate_moves(move_list, board);
+
+        for (int j = 0; j < move_list->count; j++) {
+            int move = move_list->moves[j];
+            if (expand_hash_move(COMPACT_MOVE(move), board) != move) {
+                printf("[%d] FAILURE expanding hash move ", i);
+                print_move(move);
+                printf("\n");
+                free_board(board);
+                return 0;
+            }
+        }
+
+        for (int compact = 1; compact < 0x10000; compact++) {
+            int move = expand_hash_move(compact, board);
+            if (!move) {
+                continue;
+            }
+            int found = 0;
+            for (int j = 0; j < move_list->count; j++) {
+                found |= move_list->moves[j] == move;
+            }
+            if (!found) {
+                printf("[%d] FAILURE: hash move ", i);
+                print_move(move);
+                printf(" is not pseudo-legal\n");
+                free_board(board);
+                return 0;
+            }
+        }
+    }
+    printf("Hash move tests passed\n");
+    free_board(board);
+    return 1;
+}
+
+static int contains_move(Moves *move_list, int move) {
+    for (int i = 0; i < move_list->count; i++) {
+        if (move_list->moves[i] == move) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// The captures and quiet generators must split the full move list without overlap.
+int test_split_generators() {
+    Board* board = create_board();
+    int positions = sizeof(hash_move_fens) / sizeof(hash_move_fens[0]);
+
+    for (int i = 0; i < positions; i++) {
+        load_fen(hash_move_fens[i], board);
+        Moves all[1], captures[1], quiets[1];
+        generate_moves(all, board);
+        generate_captures(captures, board);
+        generate_quiets(quiets, board);
+
+        if (captures->count + quiets->count != all->count) {
+            printf("[%d] FAILURE: %d captures + %d quiets != %d moves\n", i, captures->count, quiets->count, all->count);
+            return 0;
+        }
+
+        for (int j = 0; j < all->count; j++) {
+            int move = all->moves[j];
+            int noisy = MOVE_CAPTURE(move) || MOVE_PROMOTED(move);
+            if (!contains_move(noisy ? captures : quiets, move)) {
+                printf("[%d] FAILURE: move ", i);
+                print_move(move);
+                printf(" missing from the %s generator\n", noisy ? "captures" : "quiets");
+                return 0;
+            }
+        }
+    }
+    printf("Split move generator tests passed\n");
+    free_board(board);
+    return 1;
+}
+
+// The mailbox must match the bitboards after every make_move() and unmake_move().
+static int mailbox_matches(Board *board) {
+    for (int square = 0; square < 64; square++) {
+        int piece = -1;
+        for (int i = P; i <= k; i++) {
+            if (GET_BIT(board->bitboards[i], square)) {
+                piece = i;
+            }
+        }
+        if (board->mailbox[square] != piece) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Checks every position up to depth plies from the current one, and the positions restored by unmake_move()
+static int walk_positions(Board *board, int depth, int (*matches)(Board*)) {
+    if (!matches(board)) {
+        return 0;
+    }
+    if (depth == 0) {
+        return 1;
+    }
+    Moves move_list[1];
+    generate_moves(move_list, board);
+    for (int i = 0; i < move_list->count; i++) {
+        make_move(move_list->moves[i], board);
+        int passed = walk_positions(board, depth - 1, matches);
+        unmake_move(move_list->moves[i], board);
+        if (!passed || !matches(board)) {
+            print_move(move_list->moves[i]);
+            printf(" ");
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int test_mailbox() {
+    Board* board = create_board();
+    int positions = sizeof(hash_move_fens) / sizeof(hash_move_fens[0]);
+
+    for (int i = 0; i < positions; i++) {
+        load_fen(hash_move_fens[i], board);
+        if (!walk_positions(board, 3, mailbox_matches)) {
+            printf("\n[%d] FAILURE: mailbox does not match the bitboards\n", i);
+            return 0;
+        }
+    }
+    printf("Mailbox tests passed\n");
+    free_board(board);
+    return 1;
+}
+
+// The incrementally updated material, phase and piece-square scores must match a full recompute
+static int piece_scores_match(Board *board) {
+    PieceScores scores;
+    compute_piece_scores(board, &scores);
+    return memcmp(&scores, &board->scores, sizeof(PieceScores)) == 0;
+}
+
+int test_piece_scores() {
+    Board* board = create_board();
+    int positions = sizeof(hash_move_fens) / sizeof(hash_move_fens[0]);
+
+    for (int i = 0; i < positions; i++) {
+        load_fen(hash_move_fens[i], board);
+        if (!walk_positions(board, 3, piece_scores_match)) {
+            printf("\n[%d] FAILURE: incremental piece scores do not match the position\n", i);
+            return 0;
+        }
+    }
+    printf("Incremental piece score tests passed\n");
+    free_board(board);
+    return 1;
+}
+
+static int pawn_key_matches(Board *board) {
+    return board->pawn_key == generate_pawn_key(board);
+}
+
+// Evaluating from a pawn hash entry must give the same score as evaluating the pawns directly
+static int pawn_hash_matches(Board *board) {
+    PawnTable *table = pawn_table;
+    pawn_table = NULL;
+    int expected = evaluate(board);
+    pawn_table = table;
+    return evaluate(board) == expected && evaluate(board) == expected;
+}
+
+/**
+ * Scores one side's pawns one pawn at a time by scanning the board, the way the pawn structure was scored
+ * before evaluate_pawns() worked on whole bitboards. Sets the passed pawns.
+ */
+static int reference_pawn_score(Board *board, int side, Bitboard *passed) {
+    Bitboard own_pawns = board->bitboards[side == WHITE ? P : p];
+    Bitboard opponent_pawns = board->bitboards[side == WHITE ? p : P];
+    int score = 0;
+    *passed = 0ULL;
+
+    for (int pawn = 0; pawn < 64; pawn++) {
+        if (!GET_BIT(own_pawns, pawn)) {
+            continue;
+        }
+        int file = pawn % 8, row = pawn / 8;
+        int file_pawns = 0, neighbours = 0, stoppers = 0;
+        for (int s = 0; s < 64; s++) {
+            int distance = abs(s % 8 - file);
+            int ahead = side == WHITE ? s / 8 < row : s / 8 > row;
+            file_pawns += GET_BIT(own_pawns, s) && distance == 0;
+            neighbours += GET_BIT(own_pawns, s) && distance == 1;
+            stoppers += GET_BIT(opponent_pawns, s) && distance <= 1 && ahead;
+        }
+        if (file_pawns > 1) {
+            score += file_pawns * DOUBLE_PAWN_PENALTY;
+        }
+        if (neighbours == 0) {
+            score += ISOLATED_PAWN_PENALTY;
+        }
+        if (stoppers == 0) {
+            score += PASSED_PAWN_BONUS[side == WHITE ? 7 - row : row];
+            SET_BIT(*passed, pawn);
+        }
+    }
+    return score;
+}
+
+static int pawn_structure_matches(Board *board) {
+    PawnEntry entry;
+    evaluate_pawns(board, &entry);
+    for (int side = WHITE; side <= BLACK; side++) {
+        Bitboard passed;
+        if (reference_pawn_score(board, side, &passed) != entry.score[side] || passed != entry.passed[side]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// The setwise pawn evaluation must match scoring the pawns one at a time, over searched positions and random pawn structures
+int test_pawn_structure() {
+    Board* board = create_board();
+    int positions = sizeof(hash_move_fens) / sizeof(hash_move_fens[0]);
+
+    for (int i = 0; i < positions; i++) {
+        load_fen(hash_move_fens[i], board);
+        if (!walk_positions(board, 3, pawn_structure_matches)) {
+            printf("\n[%d] FAILURE: pawn structure does not match the per-pawn scores\n", i);
+            return 0;
+        }
+    }
+
+    // Pawns anywhere on ranks 2-7, with files of up to six pawns
+    unsigned int state = 1804289383;
+    Bitboard ranks_2_to_7 = 0x00FFFFFFFFFFFF00ULL;
+    for (int i = 0; i < 100000; i++) {
+        board->bitboards[P] = random_U64(&state) & random_U64(&state) & ranks_2_to_7;
+        board->bitboards[p] = random_U64(&state) & random_U64(&state) & ranks_2_to_7 & ~board->bitboards[P];
+        if (!pawn_structure_matches(board)) {
+            printf("\n[%d] FAILURE: random pawn structure does not match the per-pawn scores\n", i);
+            print_bitboard(board->bitboards[P]);
+            print_bitboard(board->bitboards[p]);
+            return 0;
+        }
+    }
+    printf("Pawn structure tests passed\n");
+    free_board(board);
+    return 1;
+}
+
+// Every square in a side's attack map must be attacked by that side, and every attacked square must be in the map
+static int attack_map_matches(Board *board) {
+    AttackMap attacks;
+    build_attack_map(board, &attacks);
+    for (int side = WHITE; side <= BLACK; side++) {
+        Bitboard by_piece = 0ULL;
+        for (int piece = 0; piece < 6; piece++) {
+            by_piece |= attacks.by_piece[side][piece];
+        }
+        if (by_piece != attacks.all[side]) {
+            return 0;
+        }
+        for (int square = 0; square < 64; square++) {
+            if ((GET_BIT(attacks.all[side], square) != 0) != (is_square_attacked(square, side, board) != 0)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int test_attack_map() {
+    Board* board = create_board();
+    int positions = sizeof(hash_move_fens) / sizeof(hash_move_fens[0]);
+
+    for (int i = 0; i < positions; i++) {
+        load_fen(hash_move_fens[i], board);
+        if (!walk_positions(board, 3, attack_map_matches)) {
+            printf("\n[%d] FAILURE: attack map does not match the attacked squares\n", i);
+            return 0;
+        }
+    }
+    printf("Attack map tests passed\n");
+    free_board(board);
+    return 1;
+}
+
+int test_pawn_hash() {
+    Board* board = create_board();
+    int positions = sizeof(hash_move_fens) / sizeof(hash_move_fens[0]);
+    int cache_size = eval_cache_size;
+    init_eval_cache(0); // Every evaluation must reach the pawn evaluation
+    select_pawn_table(0);
+
+    for (int i = 0; i < positions; i++) {
+        load_fen(hash_move_fens[i], board);
+        if (!walk_positions(board, 3, pawn_key_matches)) {
+            printf("\n[%d] FAILURE: incremental pawn key does not match the position\n", i);
+            return 0;
+        }
+        if (!walk_positions(board, 2, pawn_hash_matches)) {
+            printf("\n[%d] FAILURE: pawn hash entry changes the evaluation\n", i);
+            return 0;
+        }
+    }
+    printf("Pawn hash tests passed\n");
+    init_eval_cache(cache_size);
+    free_board(board);
+    return 1;
+}
+
+// A cached evaluation must match evaluating the position again
+static int eval_cache_matches(Board *board) {
+    Bitboard *cache = eval_cache;
+    eval_cache = NULL;
+    int expected = evaluate(board);
+    eval_cache = cache;
+    return evaluate(board) == expected && evaluate(board) == expected;
+}
+
+/**
+ * A lazy evaluation must be the full evaluation when that is inside the window,
+ * and otherwise must fall on the same side of the window as the full evaluation.
+ */
+static int lazy_eval_matches(Board *board) {
+    static const int offsets[] = { -800, -400, -250, -100, -30, 0, 30, 100, 250, 400, 800 };
+    Bitboard *cache = eval_cache;
+    eval_cache = NULL;
+    int expected = evaluate(board);
+    int passed = 1;
+    for (int i = 0; i < (int)(sizeof(offsets) / sizeof(offsets[0])); i++) {
+        int alpha = expected + offsets[i] - 20, beta = expected + offsets[i] + 20;
+        int score = evaluate_lazy(board, alpha, beta);
+        if (expected >= alpha && expected <= beta ? score != expected : (score < alpha) != (expected < alpha) || (score > beta) != (expected > beta)) {
+            passed = 0;
+        }
+    }
+    eval_cache = cache;
+    return passed;
+}
+
+int test_lazy_eval() {
+    Board* board = create_board();
+    int positions = sizeof(hash_move_fens) / sizeof(hash_move_fens[0]);
+
+    for (int i = 0; i < positions; i++) {
+        load_fen(hash_move_fens[i], board);
+        if (!walk_positions(board, 3, lazy_eval_matches)) {
+            printf("\n[%d] FAILURE: lazy evaluation does not agree with the full evaluation\n", i);
+            return 0;
+        }
+    }
+    printf("Lazy evaluation tests passed\n");
+    free_board(board);
+    return 1;
+}
+
+// A traced evaluation must score the same as evaluate(), with the material of the board it was given
+static int trace_matches(Board *board) {
+    Bitboard *cache = eval_cache;
+    eval_cache = NULL;
+    int expected = evaluate(board);
+    eval_cache = cache;
+
+    EvalTrace trace;
+    int score = trace_evaluation(board, &trace);
+    return score == expected && trace.material[WHITE] == get_material(board, WHITE) && trace.material[BLACK] == get_material(board, BLACK);
+}
+
+int test_eval_trace() {
+    Board* board = create_board();
+    Board* other = create_board();
+    int positions = sizeof(hash_move_fens) / sizeof(hash_move_fens[0]);
+
+    for (int i = 0; i < positions; i++) {
+        load_fen(hash_move_fens[i], board);
+        if (!walk_positions(board, 2, trace_matches)) {
+            printf("\n[%d] FAILURE: traced evaluation does not match\n", i);
+            free_board(other);
+            free_board(board);
+            return 0;
+        }
+
+        // Evaluating another board in between must not change a trace or a score
+        EvalTrace trace, other_trace;
+        int score = trace_evaluation(board, &trace);
+        load_fen(hash_move_fens[(i + 1) % positions], other);
+        trace_evaluation(other, &other_trace);
+        EvalTrace again;
+        if (trace_evaluation(board, &again) != score || memcmp(&trace, &again, sizeof(EvalTrace)) != 0) {
+            printf("\n[%d] FAILURE: evaluation depends on the previously evaluated board\n", i);
+            free_board(other);
+            free_board(board);
+            return 0;
+        }
+    }
+    printf("Evaluation trace tests passed\n");
+    free_board(other);
+    free_board(board);
+    return 1;
+}
+
+int test_eval_cache() {
+    Board* board = create_board();
+    int positions = sizeof(hash_move_fens) / sizeof(hash_move_fens[0]);
+
+    for (int i = 0; i < positions; i++) {
+        load_fen(hash_move_fens[i], board);
+        if (!walk_positions(board, 2, eval_cache_matches)) {
+            printf("\n[%d] FAILURE: cached evaluation does not match\n", i);
+            return 0;
+        }
+    }
+    printf("Evaluation cache tests passed\n");
+    free_board(board);
+    return 1;
+}
+
+static int material_key_matches(Board *board) {
+    return board->material_key == generate_material_key(board);
+}
+
+// Evaluating from a material table entry must give the same score as computing the material terms directly
+static int material_table_matches(Board *board) {
+    MaterialTable *table = material_table;
+    material_table = NULL;
+    int expected = evaluate(board);
+    material_table = table;
+    return evaluate(board) == expected && evaluate(board) == expected;
+}
+
+// Positions with captures and promotions close to the root, so the material key changes
+static char *material_fens[] = {
+    "r3k2r/pPppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "8/8/3k4/8/3r4/8/3PK3/8 w - - 0 1",
+};
+
+// Endgames with a known result, from the side to move's point of view: 1 won, 0 drawn, -1 lost
+static struct {
+    char *fen;
+    int result;
+} endgame_positions[] = {
+    { "7k/8/8/7P/5K2/8/8/8 w - - 0 1", 0 },        // Rook pawn with the defending king in the corner
+    { "8/4k3/8/4K3/4P3/8/8/8 w - - 0 1", 0 },      // The defending king has the opposition
+    { "8/4k3/8/4K3/4P3/8/8/8 b - - 0 1", -1 },     // The attacking king has the opposition
+    { "4k3/8/4K3/4P3/8/8/8/8 w - - 0 1", 1 },      // King on the sixth rank in front of the pawn
+    { "7k/8/P7/8/8/8/8/7K w - - 0 1", 1 },         // The pawn outruns the king
+    { "7k/8/8/8/8/p7/8/7K b - - 0 1", 1 },         // The same for black
+    { "8/8/8/8/8/8/3kP3/7K b - - 0 1", 0 },        // The undefended pawn is taken
+    { "8/8/8/4k3/8/8/8/R3K3 w - - 0 1", 1 },
+    { "8/8/8/4k3/8/8/8/R3K3 b - - 0 1", -1 },
+    { "8/8/8/4k3/8/8/8/1NB1K3 w - - 0 1", 1 },
+    { "8/8/8/4k3/8/8/8/1nb1K3 w - - 0 1", -1 },
+};
+
+int test_material_table() {
+    Board* board = create_board();
+    int positions = sizeof(material_fens) / sizeof(material_fens[0]);
+    int cache_size = eval_cache_size;
+    init_eval_cache(0); // Every evaluation must reach the material table
+    select_pawn_table(0);
+    select_material_table(0);
+
+    for (int i = 0; i < positions; i++) {
+        load_fen(material_fens[i], board);
+        if (!walk_positions(board, 4, material_key_matches)) {
+            printf("\n[%d] FAILURE: incremental material key does not match the position\n", i);
+            return 0;
+        }
+        if (!walk_positions(board, 3, material_table_matches)) {
+            printf("\n[%d] FAILURE: material table entry changes the evaluation\n", i);
+            return 0;
+        }
+    }
+
+    positions = sizeof(endgame_positions) / sizeof(endgame_positions[0]);
+    for (int i = 0; i < positions; i++) {
+        load_fen(endgame_positions[i].fen, board);
+        int score = evaluate(board);
+        int result = score >= KNOWN_WIN ? 1 : score <= -KNOWN_WIN ? -1 : score == 0 ? 0 : 2;
+        if (result != endgame_positions[i].result) {
+            printf("\n[%d] FAILURE: %s evaluates to %d\n", i, endgame_positions[i].fen, score);
+            return 0;
+        }
+    }
+
+    // Bishop and knight mate in the corner of the bishop's colour. c1 is a dark square, like a1.
+    load_fen("8/8/8/8/4K3/3N4/8/k1B5 w - - 0 1", board);
+    int right_corner = evaluate(board);
+    load_fen("8/8/8/8/4K3/3N4/8/2B4k w - - 0 1", board);
+    if (right_corner <= evaluate(board)) {
+        printf("\nFAILURE: KBNK does not drive the king to the bishop's corner\n");
+        return 0;
+    }
+
+    printf("Material table tests passed\n");
+    init_eval_cache(cache_size);
+    free_board(board);
+    return 1;
+}
+
+// Sums the network evaluation of every position in the tree, so backends can be compared
+static long long nnue_checksum(Board *board, int depth) {
+    long long checksum = nnue_evaluate(board);
+    if (depth == 0) {
+        return checksum;
+    }
+    Moves move_list[1];
+    generate_moves(move_list, board);
+    for (int i = 0; i < move_list->count; i++) {
+        make_move(move_list->moves[i], board);
+        checksum += nnue_checksum(board, depth - 1);
+        unmake_move(move_list->moves[i], board);
+    }
+    return checksum;
+}
+
+// Writes a network with all weights 0, so it evaluates every position to its output bias
+static int write_constant_network(const char *path, int32_t output_bias, int complete) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return 0;
+    }
+    unsigned int hidden = NNUE_HIDDEN;
+    fwrite(NNUE_MAGIC, 1, 8, file);
+    fwrite(&hidden, sizeof(hidden), 1, file);
+    int16_t zero = 0;
+    int weights = NNUE_INPUTS * NNUE_HIDDEN + NNUE_HIDDEN + 2 * NNUE_HIDDEN;
+    for (int i = 0; i < (complete ? weights : weights / 2); i++) {
+        fwrite(&zero, sizeof(zero), 1, file);
+    }
+    if (complete) {
+        fwrite(&output_bias, sizeof(output_bias), 1, file);
+    }
+    fclose(file);
+    return 1;
+}
+
+// A network file is loaded whole, and a truncated file is rejected
+static int test_network_file(Board *board, const char *path) {
+    int32_t bias = 255 * 64 * 3;
+    if (!write_constant_network(path, bias, 1) || !load_network(path)) {
+        printf("\nFAILURE: network file %s could not be loaded\n", path);
+        return 0;
+    }
+    load_fen(hash_move_fens[0], board);
+    if (nnue_evaluate(board) != bias * NNUE_SCALE / (NNUE_QA * NNUE_QB)) {
+        printf("\nFAILURE: loaded network evaluates to %d\n", nnue_evaluate(board));
+        return 0;
+    }
+    if (!write_constant_network(path, bias, 0)) {
+        printf("\nFAILURE: network file %s could not be written\n", path);
+        return 0;
+    }
+    printf("Loading a truncated network file, an error is expected:\n");
+    if (load_network(path) || strcmp(nnue_file, path) != 0) {
+        printf("\nFAILURE: truncated network file was loaded\n");
+        return 0;
+    }
+    return 1;
+}
+
+int test_nnue() {
+    Board* board = create_board();
+    int positions = sizeof(hash_move_fens) / sizeof(hash_move_fens[0]);
+    int selected = nnue_backend;
+
+    // Incremental accumulators must match a refresh, and every backend must give the same evaluations
+    init_random_network(1804289383);
+    for (int i = 0; i < positions; i++) {
+        load_fen(hash_move_fens[i], board);
+        if (!walk_positions(board, 3, accumulators_match)) {
+            printf("\n[%d] FAILURE: incremental accumulators do not match the position\n", i);
+            free_board(board);
+            return 0;
+        }
+
+        long long expected = 0;
+        for (int backend = NNUE_SCALAR; backend <= NNUE_AVX2; backend++) {
+            if (!set_nnue_backend(backend)) {
+                continue;
+            }
+            load_fen(hash_move_fens[i], board);
+            long long checksum = nnue_checksum(board, 2);
+            if (backend == NNUE_SCALAR) {
+                expected = checksum;
+            } else if (checksum != expected) {
+                printf("\n[%d] FAILURE: %s network evaluation does not match scalar\n", i, nnue_backend_names[backend]);
+                set_nnue_backend(selected);
+                free_board(board);
+                return 0;
+            }
+        }
+        set_nnue_backend(selected);
+    }
+
+    // The network files are written to the temp directory and removed whatever the result
+    char path[4096];
+    const char *directory = getenv("TMPDIR") ? getenv("TMPDIR") : getenv("TEMP") ? getenv("TEMP") : "/tmp";
+    snprintf(path, sizeof(path), "%s/thoth-test.nnue", directory);
+    int passed = test_network_file(board, path);
+    remove(path);
+    if (!passed) {
+        unload_network();
+        free_board(board);
+        return 0;
+    }
+
+    unload_network();
+    printf("NNUE tests passed\n");
+    free_board(board);
+    return 1;
+}
+
+// Every backend must return the slow ray-walk attacks for every relevant occupancy of every square.
+int test_slider_backends() {
+    // Each square's entries start where the previous square's end, and the tables end with the last square
+    int bishop_size = 0, rook_size = 0, bishop_pext_size = 0, rook_pext_size = 0;
+    for (int s = 0; s < 64; s++) {
+        if (bishop_offsets[s] != bishop_size || rook_offsets[s] != rook_size
+            || bishop_pext_offsets[s] != bishop_pext_size || rook_pext_offsets[s] != rook_pext_size) {
+            printf("FAILURE: slider table offsets of %s\n", square[s]);
+            return 0;
+        }
+        bishop_size += 1 << bishop_relevant_bits[s];
+        rook_size += 1 << rook_relevant_bits[s];
+        bishop_pext_size += 1 << count_bits(bishop_masks[s]);
+        rook_pext_size += 1 << count_bits(rook_masks[s]);
+    }
+    if (bishop_size != BISHOP_MAGIC_TABLE_SIZE || rook_size != ROOK_MAGIC_TABLE_SIZE
+        || bishop_pext_size != BISHOP_PEXT_TABLE_SIZE || rook_pext_size != ROOK_PEXT_TABLE_SIZE) {
+        printf("FAILURE: slider table sizes do not match the magic and mask bits\n");
+        return 0;
+    }
+
+    int selected = slider_backend;
+    for (int backend = SLIDERS_MAGIC; backend <= SLIDERS_PEXT; backend++) {
+        if (!set_slider_backend(backend)) {
+            printf("Skipping %s slider tests, not supported on this CPU\n", slider_backend_names[backend]);
+            continue;
+        }
+        for (int s = 0; s < 64; s++) {
+            int bishop_bits = count_bits(bishop_masks[s]);
+            int rook_bits = count_bits(rook_masks[s]);
+            for (int i = 0; i < (1 << rook_bits); i++) {
+                Bitboard occupancy = set_occupancy(i, rook_bits, rook_masks[s]);
+                if (get_rook_attacks(s, occupancy) != generate_rook_attacks(s, occupancy)) {
+                    printf("[%s] FAILURE: rook attacks on %s\n", slider_backend_names[backend], square[s]);
+                    set_slider_backend(selected);
+                    return 0;
+                }
+            }
+            for (int i = 0; i < (1 << bishop_bits); i++) {
+                Bitboard occupancy = set_occupancy(i, bishop_bits, bishop_masks[s]);
+                if (get_bishop_attacks(s, occupancy) != generate_bishop_attacks(s, occupancy)) {
+                    printf("[%s] FAILURE: bishop attacks on %s\n", slider_backend_names[backend], square[s]);
+                    set_slider_backend(selected);
+                    return 0;
+                }
+            }
+        }
+    }
+    set_slider_backend(selected);
+    printf("Slider backend tests passed\n");
+    return 1;
+}
 
 void test() {
 
@@ -125,4 +909,60 @@ void test() {
     if (test_gives_check() == 0) {
         exit(EXIT_FAILURE);
     }
+
+    if (test_transposition_table() == 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (test_hash_move() == 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (test_split_generators() == 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (test_mailbox() == 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (test_slider_backends() == 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (test_piece_scores() == 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (test_pawn_structure() == 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (test_attack_map() == 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (test_pawn_hash() == 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (test_eval_cache() == 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (test_lazy_eval() == 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (test_eval_trace() == 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (test_material_table() == 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (test_nnue() == 0) {
+        exit(EXIT_FAILURE);
+    }
 }
\ No newline at end of file
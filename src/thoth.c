@@ -11,6 +11,10 @@
 #include "search.h"
 #include "table.h"
 #include "eval.h"
+#include "endgame.h"
+#include "nnue.h"
+#include "util.h"
+#include "magics.h"
 
 #include "perft.h"
 #include "tests.h"
@@ -18,6 +22,28 @@
 #define debug_position "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1 "
 #define test_arg "test"
 #define debug_arg "debug"
+#define bench_arg "bench"
+#define movegen_arg "movegen"
+#define eval_arg "eval"
+#define BENCH_DEPTH 9
+#define MOVEGEN_BENCH_DEPTH 4
+#define MOVEGEN_BENCH_ROUNDS 20
+#define EVAL_BENCH_DEPTH 3
+#define EVAL_BENCH_ROUNDS 10
+
+// Fixed set of positions searched by the bench
+static char *bench_positions[] = {
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 ",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1 ",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1 ",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1 ",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8 ",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10 ",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4 ",
+    "2r3k1/pp3ppp/4p3/3pP3/3P1P2/1P1Q2P1/P6P/6K1 w - - 0 1 ",
+    "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1 ",
+    "8/8/4k3/8/2p5/8/B2PK3/8 w - - 0 1 ",
+};
 
 int debug_mode(char* fen, int depth) {
     Board* board = create_board();
@@ -29,6 +55,162 @@ int debug_mode(char* fen, int depth) {
     return 0;
 }
 
+/**
+ * Searches a fixed set of positions to a fixed depth and reports the total nodes and nodes per second.
+ * Used to compare the speed of the engine between changes.
+ */
+int bench(int depth) {
+    Board* board = create_board();
+    int positions = sizeof(bench_positions) / sizeof(bench_positions[0]);
+    unsigned long long nodes = 0, probes = 0, hits = 0, pawn_table_probes = 0, pawn_table_hits = 0;
+    unsigned long long eval_cache_probes = 0, eval_cache_hits = 0, lazy_eval_calls = 0, lazy_eval_exits = 0;
+    int start = get_ms();
+
+    for (int i = 0; i < positions; i++) {
+        clear_transposition_table();
+        load_fen(bench_positions[i], board);
+        search(depth, board);
+        nodes += last_search_nodes;
+        probes += tt_probes;
+        hits += tt_hits;
+        pawn_table_probes += pawn_probes;
+        pawn_table_hits += pawn_hits;
+        eval_cache_probes += eval_probes;
+        eval_cache_hits += eval_hits;
+        lazy_eval_calls += lazy_evals;
+        lazy_eval_exits += lazy_exits;
+    }
+
+    int time = get_ms() - start;
+    printf("\n===========================\n");
+    printf("Total time (ms) : %d\n", time);
+    printf("Nodes searched  : %llu\n", nodes);
+    printf("Nodes/second    : %llu\n", time > 0 ? nodes * 1000 / time : nodes);
+    printf("Hash hit rate   : %.2f%%\n", probes ? 100.0 * hits / probes : 0.0);
+    printf("Pawn hit rate   : %.2f%%\n", pawn_table_probes ? 100.0 * pawn_table_hits / pawn_table_probes : 0.0);
+    printf("Eval cache hits : %llu (%.2f%%)\n", eval_cache_hits, eval_cache_probes ? 100.0 * eval_cache_hits / eval_cache_probes : 0.0);
+    printf("Lazy eval exits : %llu (%.2f%%)\n", lazy_eval_exits, lazy_eval_calls ? 100.0 * lazy_eval_exits / lazy_eval_calls : 0.0);
+    printf("Evaluation      : %s\n", nnue_enabled ? nnue_file : "classical");
+    free_board(board);
+    return 0;
+}
+
+/**
+ * Compares the slider attack backends supported by this CPU.
+ * Times raw lookups over a fixed set of occupancies, then perft over the bench positions.
+ * The lookup checksum and perft nodes must match between backends.
+ */
+int bench_movegen(int depth) {
+    static Bitboard occupancies[4096];
+    int positions = sizeof(bench_positions) / sizeof(bench_positions[0]);
+    int selected = slider_backend;
+    Board* board = create_board();
+
+    for (int i = 0; i < 4096; i++) {
+        occupancies[i] = generate_random_U64_number() & generate_random_U64_number();
+    }
+
+    for (int backend = SLIDERS_MAGIC; backend <= SLIDERS_PEXT; backend++) {
+        if (!set_slider_backend(backend)) {
+            printf("\n%s: not supported on this CPU\n", slider_backend_names[backend]);
+            continue;
+        }
+
+        Bitboard checksum = 0;
+        int start = get_ms();
+        for (int round = 0; round < MOVEGEN_BENCH_ROUNDS; round++) {
+            for (int i = 0; i < 4096; i++) {
+                for (int square = 0; square < 64; square++) {
+                    checksum += get_bishop_attacks(square, occupancies[i]) ^ get_rook_attacks(square, occupancies[i]);
+                }
+            }
+        }
+        int lookup_time = get_ms() - start;
+        unsigned long long lookups = 2ULL * MOVEGEN_BENCH_ROUNDS * 4096 * 64;
+
+        Bitboard nodes = 0;
+        start = get_ms();
+        for (int i = 0; i < positions; i++) {
+            load_fen(bench_positions[i], board);
+            nodes += perft_nodes(depth, board);
+        }
+        int perft_time = get_ms() - start;
+
+        printf("\n%s%s\n", slider_backend_names[backend], backend == selected ? " (selected)" : "");
+        printf("Lookups/second  : %llu\n", lookup_time > 0 ? lookups * 1000 / lookup_time : lookups);
+        printf("Lookup checksum : %llx\n", checksum);
+        printf("Perft nodes     : %llu\n", nodes);
+        printf("Perft time (ms) : %d\n", perft_time);
+        printf("Nodes/second    : %llu\n", perft_time > 0 ? nodes * 1000 / perft_time : nodes);
+    }
+
+    set_slider_backend(selected);
+    free_board(board);
+    return 0;
+}
+
+// Visits every position of the tree below the board, evaluating each one when evaluations is not NULL
+static long long walk_evaluations(Board *board, int depth, unsigned long long *evaluations) {
+    long long checksum = 0;
+    if (evaluations) {
+        checksum += evaluate(board);
+        (*evaluations)++;
+    }
+    if (depth == 0) {
+        return checksum;
+    }
+    Moves move_list[1];
+    generate_moves(move_list, board);
+    for (int i = 0; i < move_list->count; i++) {
+        make_move(move_list->moves[i], board);
+        checksum += walk_evaluations(board, depth - 1, evaluations);
+        unmake_move(move_list->moves[i], board);
+    }
+    return checksum;
+}
+
+/**
+ * Times the static evaluation alone, with the evaluation cache disabled, over every position a few plies from the bench positions.
+ * The tree is also walked without evaluating, and that time is subtracted. The checksum must not change unless the evaluation does.
+ */
+int bench_eval(int rounds) {
+    int positions = sizeof(bench_positions) / sizeof(bench_positions[0]);
+    int cache_size = eval_cache_size;
+    Board* board = create_board();
+    init_eval_cache(0);
+    select_pawn_table(0);
+    select_material_table(0);
+
+    unsigned long long evaluations = 0;
+    long long checksum = 0;
+    int start = get_ms();
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < positions; i++) {
+            load_fen(bench_positions[i], board);
+            checksum += walk_evaluations(board, EVAL_BENCH_DEPTH, &evaluations);
+        }
+    }
+    int eval_time = get_ms() - start;
+
+    start = get_ms();
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < positions; i++) {
+            load_fen(bench_positions[i], board);
+            walk_evaluations(board, EVAL_BENCH_DEPTH, NULL);
+        }
+    }
+    eval_time -= get_ms() - start;
+
+    printf("Evaluations     : %llu\n", evaluations);
+    printf("Eval checksum   : %lld\n", checksum);
+    printf("Eval time (ms)  : %d\n", eval_time);
+    printf("Evals/second    : %llu\n", eval_time > 0 ? evaluations * 1000 / eval_time : evaluations);
+
+    init_eval_cache(cache_size);
+    free_board(board);
+    return 0;
+}
+
 int run_tests() {
     test();
     perft_tests();
@@ -36,7 +218,16 @@ int run_tests() {
 }
 
 void initialize() {
+#ifndef USE_GENERATED_TABLES
+    init_tables();
+    init_line_tables();
     init_hash_keys();
+    init_kpk_bitbase();
+#endif
+    init_slider_backend();
+    init_nnue_backend();
+    init_hash_table(128); // 128MB
+    init_eval_cache(DEFAULT_EVAL_CACHE);
     init_evaluation_masks();
 }
 
@@ -48,6 +239,19 @@ int main(int argc, char* argv[]) {
             int depth = argc > 3 ? atoi(argv[3]) : 10;
             return debug_mode(argc > 2 ? argv[2] : debug_position, depth);
         }
+        if (strcmp(argv[1], bench_arg) == 0) {
+            if (argc > 2 && strcmp(argv[2], movegen_arg) == 0) {
+                return bench_movegen(argc > 3 ? atoi(argv[3]) : MOVEGEN_BENCH_DEPTH);
+            }
+            if (argc > 2 && strcmp(argv[2], eval_arg) == 0) {
+                return bench_eval(argc > 3 ? atoi(argv[3]) : EVAL_BENCH_ROUNDS);
+            }
+            // An optional network file after the depth benches the network evaluation
+            if (argc > 3 && !load_network(argv[3])) {
+                return 1;
+            }
+            return bench(argc > 2 ? atoi(argv[2]) : BENCH_DEPTH);
+        }
     }
     uci_main();
 }
@@ -26,10 +26,12 @@
 #include "uci.h"
 #include "util.h"
 #include "table.h"
+#include "nnue.h"
 
 #define version "1.0.0"
 #define MAX_HASH 128
 #define MIN_HASH 4
+#define MIN_THREADS 1
 int hash_size = 64;
 
 static Board* board;
@@ -215,6 +217,10 @@ void set_info() {
     printf("id name Thoth %s\n", version);
     printf("id author Matthew Helke\n");
     printf("option name Hash type spin default %d min %d max %d\n", hash_size, MIN_HASH, MAX_HASH);
+    printf("option name Threads type spin default %d min %d max %d\n", thread_count, MIN_THREADS, MAX_THREADS);
+    printf("option name PawnHash type spin default %d min %d max %d\n", pawn_hash_size, MIN_PAWN_HASH, MAX_PAWN_HASH);
+    printf("option name EvalCache type spin default %d min %d max %d\n", eval_cache_size, MIN_EVAL_CACHE, MAX_EVAL_CACHE);
+    printf("option name EvalFile type string default <empty>\n");
     printf("uciok\n");
 }
 
@@ -270,6 +276,70 @@ int parse_line() {
         init_hash_table(hash_size);
         return 1;
     }
+    if (strncmp(input, "setoption name Threads value ", 29) == 0) {
+        sscanf(input + 29, "%d", &thread_count);
+
+        // Update thread count if out of bounds
+        if (thread_count < MIN_THREADS) {
+            thread_count = MIN_THREADS;
+        } else if (thread_count > MAX_THREADS) {
+            thread_count = MAX_THREADS;
+        }
+
+        printf("Set threads to %d\n", thread_count);
+        return 1;
+    }
+    if (strncmp(input, "setoption name PawnHash value ", 30) == 0) {
+        int size = DEFAULT_PAWN_HASH;
+        sscanf(input + 30, "%d", &size);
+
+        // Update pawn hash size if out of bounds
+        if (size < MIN_PAWN_HASH) {
+            size = MIN_PAWN_HASH;
+        } else if (size > MAX_PAWN_HASH) {
+            size = MAX_PAWN_HASH;
+        }
+
+        printf("Set pawn hash size to %dMB per thread\n", size);
+        set_pawn_hash_size(size);
+        return 1;
+    }
+    if (strncmp(input, "setoption name EvalCache value ", 31) == 0) {
+        int size = DEFAULT_EVAL_CACHE;
+        sscanf(input + 31, "%d", &size);
+
+        // Update evaluation cache size if out of bounds
+        if (size < MIN_EVAL_CACHE) {
+            size = MIN_EVAL_CACHE;
+        } else if (size > MAX_EVAL_CACHE) {
+            size = MAX_EVAL_CACHE;
+        }
+
+        printf("Set evaluation cache size to %dMB\n", size);
+        init_eval_cache(size);
+        return 1;
+    }
+    if (strncmp(input, "setoption name EvalFile value ", 30) == 0) {
+        char *path = input + 30;
+        path[strcspn(path, "\r\n")] = '\0';
+
+        // An empty path goes back to the classical evaluation
+        if (*path == '\0' || strcmp(path, "<empty>") == 0) {
+            unload_network();
+            printf("Using the classical evaluation\n");
+        } else if (load_network(path)) {
+            printf("Loaded network %s (%s)\n", path, nnue_backend_names[nnue_backend]);
+        } else {
+            printf("Using the %s evaluation\n", nnue_enabled ? "previous network" : "classical");
+        }
+
+        // Cached scores and the board's accumulators belong to the previous evaluation
+        init_eval_cache(eval_cache_size);
+        if (nnue_enabled) {
+            refresh_accumulators(board);
+        }
+        return 1;
+    }
 }
 
 void uci_main() {
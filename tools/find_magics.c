@@ -0,0 +1,170 @@
+/*
+ Searches magic numbers for every rook and bishop square in parallel and writes them as a source file to replace src/magic_numbers.c.
+ The header written with it, src/magic_numbers.h, has the magic table sizes that follow from the index bits found.
+
+ Usage: find-magics.exe <output file> <header file> [threads] [attempts] [seed]
+
+ Each square first gets a magic with one index bit per mask square, which always exists.
+ The search then tries for magics with fewer index bits, giving up on a square after attempts candidates.
+ Every square has its own random state derived from the seed, so the output depends only on the seed and attempts,
+ not on the number of threads or the order the squares finish in.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "bitboard.h"
+#include "magics.h"
+
+#define DEFAULT_THREADS 4
+#define DEFAULT_ATTEMPTS 1000000
+#define DEFAULT_SEED 1804289383
+// A magic with as many index bits as mask squares is found within a few thousand candidates, this is only a safety limit
+#define FULL_MASK_ATTEMPTS 100000000
+
+typedef struct {
+    int square;
+    int is_bishop;
+    Bitboard magic;
+    int bits;
+} MagicSearch;
+
+// One search per square, bishops first
+static MagicSearch searches[128];
+static int next_search = 0;
+static pthread_mutex_t search_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long attempts = DEFAULT_ATTEMPTS;
+static unsigned int seed = DEFAULT_SEED;
+
+static void run_search(MagicSearch *search, int index) {
+    // Scramble the seed per square. xorshift needs a non-zero state.
+    unsigned int state = seed ^ ((unsigned int)(index + 1) * 2654435761u);
+    if (state == 0) {
+        state = DEFAULT_SEED;
+    }
+
+    Bitboard mask = search->is_bishop ? mask_bishop_attacks(search->square) : mask_rook_attacks(search->square);
+    search->bits = count_bits(mask);
+    search->magic = find_magic(search->square, search->bits, search->is_bishop, &state, FULL_MASK_ATTEMPTS);
+
+    while (search->bits > 1) {
+        Bitboard magic = find_magic(search->square, search->bits - 1, search->is_bishop, &state, attempts);
+        if (!magic) {
+            break;
+        }
+        search->magic = magic;
+        search->bits--;
+    }
+}
+
+static void *search_worker(void *arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&search_lock);
+        int index = next_search++;
+        pthread_mutex_unlock(&search_lock);
+
+        if (index >= 128) {
+            return NULL;
+        }
+        MagicSearch *search = &searches[index];
+        run_search(search, index);
+
+        pthread_mutex_lock(&search_lock);
+        printf("%s %s: %d bits\n", search->is_bishop ? "bishop" : "rook", square[search->square], search->bits);
+        pthread_mutex_unlock(&search_lock);
+    }
+}
+
+static void write_magics(FILE *file, const char *name, int is_bishop) {
+    fprintf(file, "const Bitboard %s[64] = {", name);
+    for (int s = 0; s < 64; s++) {
+        if (s % 3 == 0) {
+            fprintf(file, "\n   ");
+        }
+        fprintf(file, " 0x%llxULL,", searches[is_bishop ? s : 64 + s].magic);
+    }
+    fprintf(file, "\n};\n\n");
+}
+
+static void write_bits(FILE *file, const char *name, int is_bishop) {
+    fprintf(file, "const int %s[64] = {", name);
+    for (int s = 0; s < 64; s++) {
+        if (s % 8 == 0) {
+            fprintf(file, "\n   ");
+        }
+        fprintf(file, " %d,", searches[is_bishop ? s : 64 + s].bits);
+    }
+    fprintf(file, "\n};\n\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf("Usage: %s <output file> <header file> [threads] [attempts] [seed]\n", argv[0]);
+        return 1;
+    }
+    int threads = argc > 3 ? atoi(argv[3]) : DEFAULT_THREADS;
+    if (argc > 4) {
+        attempts = atol(argv[4]);
+    }
+    if (argc > 5) {
+        seed = (unsigned int)strtoul(argv[5], NULL, 10);
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    for (int s = 0; s < 64; s++) {
+        searches[s] = (MagicSearch){ .square = s, .is_bishop = 1 };
+        searches[64 + s] = (MagicSearch){ .square = s, .is_bishop = 0 };
+    }
+
+    pthread_t workers[threads];
+    for (int i = 0; i < threads; i++) {
+        pthread_create(&workers[i], NULL, search_worker, NULL);
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    int bishop_size = 0, rook_size = 0;
+    for (int s = 0; s < 64; s++) {
+        if (!searches[s].magic || !searches[64 + s].magic) {
+            printf("No magic found for %s\n", square[s]);
+            return 1;
+        }
+        bishop_size += 1 << searches[s].bits;
+        rook_size += 1 << searches[64 + s].bits;
+    }
+    printf("Magic table entries: bishop %d (mask bits %d), rook %d (mask bits %d)\n",
+        bishop_size, BISHOP_PEXT_TABLE_SIZE, rook_size, ROOK_PEXT_TABLE_SIZE);
+
+    FILE *file = fopen(argv[1], "w");
+    if (file == NULL) {
+        printf("Could not open %s for writing\n", argv[1]);
+        return 1;
+    }
+    fprintf(file, "// Generated by tools/find_magics.c (make magics) with seed %u and %ld attempts per reduced bit count.\n", seed, attempts);
+    fprintf(file, "#include \"bitboard.h\"\n\n");
+    write_magics(file, "rook_magics", 0);
+    write_magics(file, "bishop_magics", 1);
+    fprintf(file, "// The number of bits in the magic index of each square, at most the number of squares in its attack mask.\n");
+    write_bits(file, "bishop_relevant_bits", 1);
+    write_bits(file, "rook_relevant_bits", 0);
+    fclose(file);
+
+    file = fopen(argv[2], "w");
+    if (file == NULL) {
+        printf("Could not open %s for writing\n", argv[2]);
+        return 1;
+    }
+    fprintf(file, "// Generated by tools/find_magics.c (make magics) with seed %u and %ld attempts per reduced bit count.\n", seed, attempts);
+    fprintf(file, "#ifndef MAGIC_NUMBERS_H\n#define MAGIC_NUMBERS_H\n\n");
+    fprintf(file, "// Total entries of each magic slider table: the sum over all squares of 2^(relevant bits)\n");
+    fprintf(file, "#define BISHOP_MAGIC_TABLE_SIZE %d\n", bishop_size);
+    fprintf(file, "#define ROOK_MAGIC_TABLE_SIZE %d\n\n", rook_size);
+    fprintf(file, "#endif\n");
+    fclose(file);
+    return 0;
+}
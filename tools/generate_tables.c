@@ -0,0 +1,108 @@
+/*
+ Writes the attack tables and Zobrist keys as const C data, so the engine can be built without any table construction at startup.
+ The tables are built by the same code the engine uses at runtime, so both builds hash and move identically.
+
+ Usage: generate-tables.exe <output directory>
+ Writes generated_attacks.h, generated_keys.h and generated_endgames.h, which bitboard.c, table.c and endgame.c include
+ when built with USE_GENERATED_TABLES.
+*/
+#include <stdio.h>
+
+#include "bitboard.h"
+#include "table.h"
+#include "endgame.h"
+
+static void write_values(FILE *file, const Bitboard *values, int count) {
+    for (int i = 0; i < count; i++) {
+        if (i % 4 == 0) {
+            fprintf(file, "\n    ");
+        }
+        fprintf(file, "0x%016llxULL,", values[i]);
+    }
+}
+
+static void write_offsets(FILE *file, const char *declaration, const int *offsets) {
+    fprintf(file, "const int %s = {", declaration);
+    for (int i = 0; i < 64; i++) {
+        if (i % 8 == 0) {
+            fprintf(file, "\n    ");
+        }
+        fprintf(file, "%d,", offsets[i]);
+    }
+    fprintf(file, "\n};\n\n");
+}
+
+static void write_table(FILE *file, const char *declaration, const Bitboard *values, int rows, int columns) {
+    fprintf(file, "const Bitboard %s = {", declaration);
+    if (rows == 1) {
+        write_values(file, values, columns);
+    } else {
+        for (int row = 0; row < rows; row++) {
+            fprintf(file, "\n{");
+            write_values(file, values + row * columns, columns);
+            fprintf(file, "\n},");
+        }
+    }
+    fprintf(file, "\n};\n\n");
+}
+
+static FILE *open_output(const char *directory, const char *name) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        printf("Could not open %s for writing\n", path);
+        return NULL;
+    }
+    fprintf(file, "// Generated by tools/generate_tables.c (make tables). Do not edit.\n\n");
+    return file;
+}
+
+int main(int argc, char **argv) {
+    const char *directory = argc > 1 ? argv[1] : "src";
+
+    init_tables();
+    init_line_tables();
+    init_hash_keys();
+    init_kpk_bitbase();
+
+    FILE *file = open_output(directory, "generated_attacks.h");
+    if (file == NULL) {
+        return 1;
+    }
+    write_table(file, "bishop_masks[64]", bishop_masks, 1, 64);
+    write_table(file, "rook_masks[64]", rook_masks, 1, 64);
+    write_table(file, "pawn_attacks[2][64]", &pawn_attacks[0][0], 2, 64);
+    write_table(file, "knight_attacks[64]", knight_attacks, 1, 64);
+    write_table(file, "king_attacks[64]", king_attacks, 1, 64);
+    write_table(file, "bishop_attacks[BISHOP_MAGIC_TABLE_SIZE]", bishop_attacks, 1, BISHOP_MAGIC_TABLE_SIZE);
+    write_table(file, "rook_attacks[ROOK_MAGIC_TABLE_SIZE]", rook_attacks, 1, ROOK_MAGIC_TABLE_SIZE);
+    write_table(file, "bishop_pext_attacks[BISHOP_PEXT_TABLE_SIZE]", bishop_pext_attacks, 1, BISHOP_PEXT_TABLE_SIZE);
+    write_table(file, "rook_pext_attacks[ROOK_PEXT_TABLE_SIZE]", rook_pext_attacks, 1, ROOK_PEXT_TABLE_SIZE);
+    write_offsets(file, "bishop_offsets[64]", bishop_offsets);
+    write_offsets(file, "rook_offsets[64]", rook_offsets);
+    write_offsets(file, "bishop_pext_offsets[64]", bishop_pext_offsets);
+    write_offsets(file, "rook_pext_offsets[64]", rook_pext_offsets);
+    write_table(file, "between_squares[64][64]", &between_squares[0][0], 64, 64);
+    write_table(file, "line_squares[64][64]", &line_squares[0][0], 64, 64);
+    fclose(file);
+
+    file = open_output(directory, "generated_keys.h");
+    if (file == NULL) {
+        return 1;
+    }
+    write_table(file, "piece_keys[12][64]", &piece_keys[0][0], 12, 64);
+    write_table(file, "enpassant_keys[64]", enpassant_keys, 1, 64);
+    write_table(file, "castling_keys[16]", castling_keys, 1, 16);
+    fprintf(file, "const Bitboard side_key = 0x%016llxULL;\n", side_key);
+    fclose(file);
+
+    file = open_output(directory, "generated_endgames.h");
+    if (file == NULL) {
+        return 1;
+    }
+    write_table(file, "kpk_bitbase[KPK_SIZE / 64]", kpk_bitbase, 1, KPK_SIZE / 64);
+    fclose(file);
+
+    return 0;
+}